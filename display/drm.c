@@ -9,6 +9,22 @@
 #include "drm.h"
 #if USE_DRM
 
+#ifndef DRM_HOTPLUG
+#define DRM_HOTPLUG 0
+#endif
+
+#ifndef DRM_USE_MODIFIERS
+#define DRM_USE_MODIFIERS 0
+#endif
+
+#ifndef DRM_SEAMLESS_STARTUP
+#define DRM_SEAMLESS_STARTUP 0
+#endif
+
+#ifndef DRM_HOTPLUG_POLL_PERIOD
+#define DRM_HOTPLUG_POLL_PERIOD 0
+#endif
+
 #include <unistd.h>
 #include <pthread.h>
 #include <time.h>
@@ -22,20 +38,48 @@
 #include <errno.h>
 #include <sys/mman.h>
 #include <inttypes.h>
+#if DRM_HOTPLUG
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#endif
 
 #include <xf86drm.h>
 #include <xf86drmMode.h>
 #include <drm_fourcc.h>
 
+#if LV_COLOR_DEPTH == 16
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+#endif
+
 #define DBG_TAG "drm"
 
+#define DRM_IDLE_CHECK_PERIOD 100 /*ms*/
+
 #define DIV_ROUND_UP(n, d) (((n) + (d) - 1) / (d))
+#define ALIGN_UP(n, a) (DIV_ROUND_UP(n, a) * (a))
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
 
 #define print(msg, ...)	fprintf(stderr, msg, ##__VA_ARGS__);
 #define err(msg, ...)  print("error: " msg "\n", ##__VA_ARGS__)
 #define info(msg, ...) print(msg "\n", ##__VA_ARGS__)
 #define dbg(msg, ...)  {} //print(DBG_TAG ": " msg "\n", ##__VA_ARGS__)
 
+/*
+ * Tiled layouts are made of tiles of `tile_h` rows of `tile_w` bytes. Tiles
+ * follow each other in row order, a tile row holds `tile_w / span` columns
+ * of `span` bytes wide and `tile_h` rows high, stored one after the other.
+ */
+struct drm_tiling {
+	uint64_t modifier;
+	uint32_t tile_w;
+	uint32_t tile_h;
+	uint32_t span;
+};
+
 struct drm_buffer {
 	uint32_t handle;
 	uint32_t pitch;
@@ -48,9 +92,14 @@ struct drm_buffer {
 struct drm_dev {
 	int fd;
 	uint32_t conn_id, enc_id, crtc_id, plane_id, crtc_idx;
+	uint32_t detach_conn_id; /* connector to unroute from the CRTC on the next modeset */
+	uint32_t max_pixels; /* largest mode the draw buffer can hold, 0 for any */
 	uint32_t width, height;
 	uint32_t mmWidth, mmHeight;
 	uint32_t fourcc;
+	uint32_t cpp; /* bytes per pixel of the plane format */
+	const struct drm_tiling *tiling; /* NULL for linear buffers */
+	uint32_t linear_plane_id, linear_fourcc; /* the kernel rejected tiled FBs for them */
 	drmModeModeInfo mode;
 	uint32_t blob_id;
 	drmModeCrtc *saved_crtc;
@@ -67,7 +116,86 @@ struct drm_dev {
 	drmModePropertyPtr conn_props[128];
 	struct drm_buffer drm_bufs[2]; /* DUMB buffers */
 	struct drm_buffer *cur_bufs[2]; /* double buffering handling */
-} drm_dev;
+	int modeset; /* next commit has to (re)do the modeset */
+	int seamless; /* the CRTC already runs our mode, first commit only flips */
+	int active; /* CRTC is scanning out, 0 while blanked */
+	int dpms_legacy; /* blanked through the connector DPMS property */
+	int flush_skipped; /* LVGL flushed while blanked */
+	uint32_t idle_timeout;
+	lv_timer_t *idle_timer;
+	int connected; /* a connector with a mode was found on the last probe */
+	int hotplug_fd; /* kernel uevent socket */
+	lv_timer_t *hotplug_timer;
+} drm_dev = {
+	.fd = -1, /* the public calls are no-ops until drm_init() */
+	.hotplug_fd = -1,
+};
+
+/*
+ * Plane formats in order of preference. The LVGL color depth only decides the
+ * layout of the draw buffer: if the plane can't scan it out natively the
+ * pixels are converted while copying the damaged area in drm_flush().
+ */
+#if LV_COLOR_DEPTH == 32
+static const uint32_t drm_formats[] = {
+	DRM_FORMAT_ARGB8888,
+	DRM_FORMAT_XRGB8888,
+};
+#elif LV_COLOR_DEPTH == 16
+static const uint32_t drm_formats[] = {
+	DRM_FORMAT_RGB565,
+	DRM_FORMAT_XRGB8888,
+	DRM_FORMAT_ARGB8888,
+};
+#else
+#error LV_COLOR_DEPTH not supported
+#endif
+
+/*
+ * Tiled layouts the flush path can write, in order of preference.
+ * Bit 6 swizzling of older Intel GPUs is not supported: the CPU writes the
+ * layout as is, so on such platforms the tiled image would be scrambled.
+ */
+static const struct drm_tiling drm_tilings[] = {
+	{ I915_FORMAT_MOD_X_TILED, 512, 8, 512 },
+	{ I915_FORMAT_MOD_Y_TILED, 128, 32, 16 },
+};
+
+static const struct drm_tiling *drm_get_tiling(uint64_t modifier)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(drm_tilings); i++) {
+		if (drm_tilings[i].modifier == modifier)
+			return &drm_tilings[i];
+	}
+
+	return NULL;
+}
+
+/* Byte offset of the byte column `xb` in row `y` of a tiled buffer */
+static inline uint32_t drm_tile_offset(const struct drm_tiling *t, uint32_t pitch,
+				       uint32_t xb, uint32_t y)
+{
+	return (y / t->tile_h) * pitch * t->tile_h +
+	       (xb / t->tile_w) * t->tile_w * t->tile_h +
+	       ((xb % t->tile_w) / t->span) * t->span * t->tile_h +
+	       (y % t->tile_h) * t->span +
+	       xb % t->span;
+}
+
+static uint32_t drm_format_cpp(uint32_t fourcc)
+{
+	switch (fourcc) {
+	case DRM_FORMAT_RGB565:
+		return 2;
+	case DRM_FORMAT_XRGB8888:
+	case DRM_FORMAT_ARGB8888:
+		return 4;
+	default:
+		return 0;
+	}
+}
 
 static uint32_t get_plane_property_id(const char *name)
 {
@@ -240,47 +368,101 @@ static int drm_add_conn_property(const char *name, uint64_t value)
 	return 0;
 }
 
+static void drm_add_plane_fb(struct drm_buffer *buf)
+{
+	drm_add_plane_property("FB_ID", buf->fb_handle);
+	drm_add_plane_property("CRTC_ID", drm_dev.crtc_id);
+	drm_add_plane_property("SRC_X", 0);
+	drm_add_plane_property("SRC_Y", 0);
+	drm_add_plane_property("SRC_W", drm_dev.width << 16);
+	drm_add_plane_property("SRC_H", drm_dev.height << 16);
+	drm_add_plane_property("CRTC_X", 0);
+	drm_add_plane_property("CRTC_Y", 0);
+	drm_add_plane_property("CRTC_W", drm_dev.width);
+	drm_add_plane_property("CRTC_H", drm_dev.height);
+}
+
 static int drm_dmabuf_set_plane(struct drm_buffer *buf)
 {
 	int ret;
-	static int first = 1;
 	uint32_t flags = DRM_MODE_PAGE_FLIP_EVENT;
 
 	drm_dev.req = drmModeAtomicAlloc();
 
-	/* On first Atomic commit, do a modeset */
-	if (first) {
+	/* The mode set by the bootloader is kept, only swap the plane's FB */
+	if (drm_dev.modeset && drm_dev.seamless) {
+		drm_dev.seamless = 0;
+
+		drm_add_plane_fb(buf);
+
+		ret = drmModeAtomicCommit(drm_dev.fd, drm_dev.req, flags, NULL);
+		if (!ret) {
+			drm_dev.modeset = 0;
+			info("drm: reused the running mode, no modeset");
+			return 0;
+		}
+
+		/* The driver wants a modeset after all, do a full one */
+		dbg("seamless commit failed: %s", strerror(errno));
+		drmModeAtomicFree(drm_dev.req);
+		drm_dev.req = drmModeAtomicAlloc();
+	}
+
+	/* On first Atomic commit (or after a blank), do a modeset */
+	if (drm_dev.modeset) {
 		drm_add_conn_property("CRTC_ID", drm_dev.crtc_id);
 
+		/* Connector properties are device wide, CRTC_ID has the same id on every connector */
+		if (drm_dev.detach_conn_id && drm_dev.detach_conn_id != drm_dev.conn_id)
+			drmModeAtomicAddProperty(drm_dev.req, drm_dev.detach_conn_id,
+						 get_conn_property_id("CRTC_ID"), 0);
+
 		drm_add_crtc_property("MODE_ID", drm_dev.blob_id);
 		drm_add_crtc_property("ACTIVE", 1);
 
 		flags |= DRM_MODE_ATOMIC_ALLOW_MODESET;
 
-		first = 0;
+		drm_dev.modeset = 0;
 	}
 
-	drm_add_plane_property("FB_ID", buf->fb_handle);
-	drm_add_plane_property("CRTC_ID", drm_dev.crtc_id);
-	drm_add_plane_property("SRC_X", 0);
-	drm_add_plane_property("SRC_Y", 0);
-	drm_add_plane_property("SRC_W", drm_dev.width << 16);
-	drm_add_plane_property("SRC_H", drm_dev.height << 16);
-	drm_add_plane_property("CRTC_X", 0);
-	drm_add_plane_property("CRTC_Y", 0);
-	drm_add_plane_property("CRTC_W", drm_dev.width);
-	drm_add_plane_property("CRTC_H", drm_dev.height);
+	drm_add_plane_fb(buf);
 
 	ret = drmModeAtomicCommit(drm_dev.fd, drm_dev.req, flags, NULL);
 	if (ret) {
 		err("drmModeAtomicCommit failed: %s", strerror(errno));
 		drmModeAtomicFree(drm_dev.req);
+		drm_dev.req = NULL;
 		return ret;
 	}
 
+	if (flags & DRM_MODE_ATOMIC_ALLOW_MODESET)
+		drm_dev.detach_conn_id = 0;
+
 	return 0;
 }
 
+/* Switch the CRTC off and detach the plane so nothing is scanned out */
+static int drm_dmabuf_disable(void)
+{
+	int ret;
+
+	drm_dev.req = drmModeAtomicAlloc();
+
+	drm_add_crtc_property("ACTIVE", 0);
+	drm_add_plane_property("FB_ID", 0);
+	drm_add_plane_property("CRTC_ID", 0);
+
+	/* No page flip event: a disabled CRTC doesn't send one */
+	ret = drmModeAtomicCommit(drm_dev.fd, drm_dev.req, DRM_MODE_ATOMIC_ALLOW_MODESET, NULL);
+	if (ret)
+		err("drmModeAtomicCommit failed: %s", strerror(errno));
+
+	drmModeAtomicFree(drm_dev.req);
+	drm_dev.req = NULL;
+
+	return ret;
+}
+
 static int find_plane(unsigned int fourcc, uint32_t *plane_id, uint32_t crtc_id, uint32_t crtc_idx)
 {
 	drmModePlaneResPtr planes;
@@ -340,6 +522,7 @@ static int drm_find_connector(void)
 {
 	drmModeConnector *conn = NULL;
 	drmModeEncoder *enc = NULL;
+	drmModeModeInfo *mode;
 	drmModeRes *res;
 	int i;
 
@@ -393,7 +576,20 @@ static int drm_find_connector(void)
 	drm_dev.mmWidth = conn->mmWidth;
 	drm_dev.mmHeight = conn->mmHeight;
 
-	memcpy(&drm_dev.mode, &conn->modes[0], sizeof(drmModeModeInfo));
+	/* The preferred mode comes first, skip the ones the draw buffer can't hold */
+	mode = &conn->modes[0];
+	for (i = 0; drm_dev.max_pixels && i < conn->count_modes; i++) {
+		mode = &conn->modes[i];
+		if ((uint32_t)mode->hdisplay * mode->vdisplay <= drm_dev.max_pixels)
+			break;
+	}
+
+	if (i == conn->count_modes) {
+		err("no mode fits the draw buffer of %u pixels", drm_dev.max_pixels);
+		goto free_res;
+	}
+
+	memcpy(&drm_dev.mode, mode, sizeof(drmModeModeInfo));
 
 	if (drmModeCreatePropertyBlob(drm_dev.fd, &drm_dev.mode, sizeof(drm_dev.mode),
 				      &drm_dev.blob_id)) {
@@ -401,8 +597,8 @@ static int drm_find_connector(void)
 		goto free_res;
 	}
 
-	drm_dev.width = conn->modes[0].hdisplay;
-	drm_dev.height = conn->modes[0].vdisplay;
+	drm_dev.width = mode->hdisplay;
+	drm_dev.height = mode->vdisplay;
 
 	for (i = 0 ; i < res->count_encoders; i++) {
 		enc = drmModeGetEncoder(drm_dev.fd, res->encoders[i]);
@@ -480,9 +676,14 @@ static int drm_find_connector(void)
 
 	dbg("crtc_idx: %d", drm_dev.crtc_idx);
 
+	drmModeFreeConnector(conn);
+	drmModeFreeResources(res);
+
 	return 0;
 
 free_res:
+	if (conn)
+		drmModeFreeConnector(conn);
 	drmModeFreeResources(res);
 
 	return -1;
@@ -521,76 +722,226 @@ err:
 	return -1;
 }
 
-static int drm_setup(unsigned int fourcc)
+#if DRM_USE_MODIFIERS
+/* Pick a tiled layout supported for the plane format according to IN_FORMATS */
+static const struct drm_tiling *drm_choose_tiling(void)
 {
-	int ret;
-	const char *device_path = NULL;
+	drmModeObjectPropertiesPtr props;
+	drmModePropertyBlobPtr blob = NULL;
+	const struct drm_format_modifier_blob *hdr;
+	const struct drm_format_modifier *mods;
+	const struct drm_tiling *tiling = NULL;
+	const uint32_t *formats;
+	uint64_t cap = 0;
+	uint32_t prop_id, blob_id = 0;
+	uint32_t i, j, fmt;
+
+	if (drmGetCap(drm_dev.fd, DRM_CAP_ADDFB2_MODIFIERS, &cap) || !cap)
+		return NULL;
+
+	prop_id = get_plane_property_id("IN_FORMATS");
+	if (!prop_id)
+		return NULL;
+
+	props = drmModeObjectGetProperties(drm_dev.fd, drm_dev.plane_id, DRM_MODE_OBJECT_PLANE);
+	if (!props)
+		return NULL;
 
-	device_path = getenv("DRM_CARD");
-	if (!device_path)
-		device_path = DRM_CARD;
+	for (i = 0; i < props->count_props; i++) {
+		if (props->props[i] == prop_id)
+			blob_id = props->prop_values[i];
+	}
+	drmModeFreeObjectProperties(props);
 
-	drm_dev.fd = drm_open(device_path);
-	if (drm_dev.fd < 0)
-		return -1;
+	if (blob_id)
+		blob = drmModeGetPropertyBlob(drm_dev.fd, blob_id);
+	if (!blob)
+		return NULL;
 
-	ret = drmSetClientCap(drm_dev.fd, DRM_CLIENT_CAP_ATOMIC, 1);
-	if (ret) {
-		err("No atomic modesetting support: %s", strerror(errno));
-		goto err;
+	hdr = blob->data;
+	formats = (const uint32_t *)((const uint8_t *)hdr + hdr->formats_offset);
+	mods = (const struct drm_format_modifier *)((const uint8_t *)hdr + hdr->modifiers_offset);
+
+	for (fmt = 0; fmt < hdr->count_formats; fmt++) {
+		if (formats[fmt] == drm_dev.fourcc)
+			break;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(drm_tilings) && !tiling && fmt < hdr->count_formats; i++) {
+		for (j = 0; j < hdr->count_modifiers; j++) {
+			/* Each entry covers a window of 64 formats starting at `offset` */
+			if (mods[j].modifier != drm_tilings[i].modifier ||
+			    fmt < mods[j].offset || fmt >= mods[j].offset + 64)
+				continue;
+
+			if (mods[j].formats & (1ULL << (fmt - mods[j].offset))) {
+				tiling = &drm_tilings[i];
+				break;
+			}
+		}
+	}
+
+	drmModeFreePropertyBlob(blob);
+
+	return tiling;
+}
+#endif /*DRM_USE_MODIFIERS*/
+
+/* Compare the timings only, the name and type don't change what is shown */
+static int drm_mode_equal(const drmModeModeInfo *a, const drmModeModeInfo *b)
+{
+	return a->clock == b->clock &&
+	       a->hdisplay == b->hdisplay && a->hsync_start == b->hsync_start &&
+	       a->hsync_end == b->hsync_end && a->htotal == b->htotal &&
+	       a->hskew == b->hskew &&
+	       a->vdisplay == b->vdisplay && a->vsync_start == b->vsync_start &&
+	       a->vsync_end == b->vsync_end && a->vtotal == b->vtotal &&
+	       a->vscan == b->vscan && a->flags == b->flags;
+}
+
+#if DRM_SEAMLESS_STARTUP
+/*
+ * If the CRTC already drives the connector (e.g. with a bootloader splash)
+ * in the mode picked for it, the first commit doesn't need a modeset which
+ * blanks the display. A different running mode is replaced as usual.
+ */
+static void drm_keep_running_mode(void)
+{
+	drmModeCrtc *crtc = drm_dev.saved_crtc;
+
+	if (!crtc || !crtc->mode_valid || drm_dev.conn->encoder_id != drm_dev.enc_id)
+		return;
+
+	if (!drm_mode_equal(&drm_dev.mode, &crtc->mode)) {
+		dbg("running mode %s differs from %s, modeset needed", crtc->mode.name, drm_dev.mode.name);
+		return;
 	}
 
+	drm_dev.seamless = 1;
+
+	info("drm: CRTC %u already runs %s, keeping it", drm_dev.crtc_id, drm_dev.mode.name);
+}
+#endif /*DRM_SEAMLESS_STARTUP*/
+
+static void drm_free_props(drmModePropertyPtr *props, uint32_t *count)
+{
+	uint32_t i;
+
+	for (i = 0; i < *count; i++)
+		drmModeFreeProperty(props[i]);
+
+	*count = 0;
+}
+
+/* Free the mode blob, objects and properties found by a probe */
+static void drm_probe_release(struct drm_dev *dev)
+{
+	if (dev->blob_id) {
+		drmModeDestroyPropertyBlob(dev->fd, dev->blob_id);
+		dev->blob_id = 0;
+	}
+
+	if (dev->plane) {
+		drmModeFreePlane(dev->plane);
+		dev->plane = NULL;
+	}
+
+	if (dev->crtc) {
+		drmModeFreeCrtc(dev->crtc);
+		dev->crtc = NULL;
+	}
+
+	if (dev->conn) {
+		drmModeFreeConnector(dev->conn);
+		dev->conn = NULL;
+	}
+
+	drm_free_props(dev->plane_props, &dev->count_plane_props);
+	drm_free_props(dev->crtc_props, &dev->count_crtc_props);
+	drm_free_props(dev->conn_props, &dev->count_conn_props);
+}
+
+/* Look up connector, CRTC and plane into drm_dev */
+static int drm_probe_objects(void)
+{
+	int ret;
+	unsigned int i;
+	uint32_t fourcc = 0;
+
 	ret = drm_find_connector();
 	if (ret) {
 		err("available drm devices not found");
-		goto err;
+		return -1;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(drm_formats); i++) {
+		ret = find_plane(drm_formats[i], &drm_dev.plane_id, drm_dev.crtc_id, drm_dev.crtc_idx);
+		if (!ret) {
+			fourcc = drm_formats[i];
+			break;
+		}
 	}
 
-	ret = find_plane(fourcc, &drm_dev.plane_id, drm_dev.crtc_id, drm_dev.crtc_idx);
 	if (ret) {
 		err("Cannot find plane");
-		goto err;
+		return -1;
 	}
 
 	drm_dev.plane = drmModeGetPlane(drm_dev.fd, drm_dev.plane_id);
 	if (!drm_dev.plane) {
 		err("Cannot get plane");
-		goto err;
+		return -1;
 	}
 
 	drm_dev.crtc = drmModeGetCrtc(drm_dev.fd, drm_dev.crtc_id);
 	if (!drm_dev.crtc) {
 		err("Cannot get crtc");
-		goto err;
+		return -1;
 	}
 
 	drm_dev.conn = drmModeGetConnector(drm_dev.fd, drm_dev.conn_id);
 	if (!drm_dev.conn) {
 		err("Cannot get connector");
-		goto err;
+		return -1;
+	}
+
+	/* Remember what was shown before us, on the first probe only */
+	if (!drm_dev.saved_crtc) {
+		drm_dev.saved_crtc = drmModeGetCrtc(drm_dev.fd, drm_dev.crtc_id);
+#if DRM_SEAMLESS_STARTUP
+		drm_keep_running_mode();
+#endif
 	}
 
 	ret = drm_get_plane_props();
 	if (ret) {
 		err("Cannot get plane props");
-		goto err;
+		return -1;
 	}
 
 	ret = drm_get_crtc_props();
 	if (ret) {
 		err("Cannot get crtc props");
-		goto err;
+		return -1;
 	}
 
 	ret = drm_get_conn_props();
 	if (ret) {
 		err("Cannot get connector props");
-		goto err;
+		return -1;
 	}
 
-	drm_dev.drm_event_ctx.version = DRM_EVENT_CONTEXT_VERSION;
-	drm_dev.drm_event_ctx.page_flip_handler = page_flip_handler;
 	drm_dev.fourcc = fourcc;
+	drm_dev.cpp = drm_format_cpp(fourcc);
+	drm_dev.tiling = NULL;
+
+#if DRM_USE_MODIFIERS
+	/* Don't try again a layout refused on a previous probe, that would re-create the buffers */
+	if (drm_dev.plane_id != drm_dev.linear_plane_id || fourcc != drm_dev.linear_fourcc)
+		drm_dev.tiling = drm_choose_tiling();
+	if (drm_dev.tiling)
+		info("drm: using tiled buffers, modifier 0x%016" PRIx64, drm_dev.tiling->modifier);
+#endif
 
 	info("drm: Found plane_id: %u connector_id: %d crtc_id: %d",
 		drm_dev.plane_id, drm_dev.conn_id, drm_dev.crtc_id);
@@ -600,6 +951,64 @@ static int drm_setup(unsigned int fourcc)
 	     (fourcc>>0)&0xff, (fourcc>>8)&0xff, (fourcc>>16)&0xff, (fourcc>>24)&0xff);
 
 	return 0;
+}
+
+/*
+ * Called on init and on every hotplug. The objects of the previous probe are
+ * only released once the new probe succeeded, a failed re-probe keeps them.
+ */
+static int drm_probe(void)
+{
+	struct drm_dev prev = drm_dev;
+
+	drm_dev.blob_id = 0;
+	drm_dev.plane = NULL;
+	drm_dev.crtc = NULL;
+	drm_dev.conn = NULL;
+	drm_dev.count_plane_props = 0;
+	drm_dev.count_crtc_props = 0;
+	drm_dev.count_conn_props = 0;
+
+	if (drm_probe_objects()) {
+		drm_probe_release(&drm_dev);
+		if (drm_dev.saved_crtc != prev.saved_crtc)
+			drmModeFreeCrtc(drm_dev.saved_crtc);
+		drm_dev = prev;
+		return -1;
+	}
+
+	drm_probe_release(&prev);
+
+	return 0;
+}
+
+static int drm_setup(void)
+{
+	int ret;
+	const char *device_path = NULL;
+
+	device_path = getenv("DRM_CARD");
+	if (!device_path)
+		device_path = DRM_CARD;
+
+	drm_dev.fd = drm_open(device_path);
+	if (drm_dev.fd < 0)
+		return -1;
+
+	ret = drmSetClientCap(drm_dev.fd, DRM_CLIENT_CAP_ATOMIC, 1);
+	if (ret) {
+		err("No atomic modesetting support: %s", strerror(errno));
+		goto err;
+	}
+
+	ret = drm_probe();
+	if (ret)
+		goto err;
+
+	drm_dev.drm_event_ctx.version = DRM_EVENT_CONTEXT_VERSION;
+	drm_dev.drm_event_ctx.page_flip_handler = page_flip_handler;
+
+	return 0;
 
 err:
 	close(drm_dev.fd);
@@ -617,7 +1026,14 @@ static int drm_allocate_dumb(struct drm_buffer *buf)
 	memset(&creq, 0, sizeof(creq));
 	creq.width = drm_dev.width;
 	creq.height = drm_dev.height;
-	creq.bpp = LV_COLOR_DEPTH;
+	creq.bpp = drm_dev.cpp * 8;
+
+	/* tiled buffers are made of whole tiles */
+	if (drm_dev.tiling) {
+		creq.width = ALIGN_UP(drm_dev.width * drm_dev.cpp, drm_dev.tiling->tile_w) / drm_dev.cpp;
+		creq.height = ALIGN_UP(drm_dev.height, drm_dev.tiling->tile_h);
+	}
+
 	ret = drmIoctl(drm_dev.fd, DRM_IOCTL_MODE_CREATE_DUMB, &creq);
 	if (ret < 0) {
 		err("DRM_IOCTL_MODE_CREATE_DUMB fail");
@@ -655,6 +1071,30 @@ static int drm_allocate_dumb(struct drm_buffer *buf)
 	handles[0] = creq.handle;
 	pitches[0] = creq.pitch;
 	offsets[0] = 0;
+
+	if (drm_dev.tiling) {
+		uint64_t modifiers[4] = { drm_dev.tiling->modifier };
+
+		ret = -1;
+		if (creq.pitch % drm_dev.tiling->tile_w == 0)
+			ret = drmModeAddFB2WithModifiers(drm_dev.fd, drm_dev.width, drm_dev.height,
+							 drm_dev.fourcc, handles, pitches, offsets,
+							 modifiers, &buf->fb_handle, DRM_MODE_FB_MODIFIERS);
+		if (!ret)
+			return 0;
+
+		/* Both buffers must share the layout, only the first one may fall back */
+		if (buf != &drm_dev.drm_bufs[0]) {
+			err("drmModeAddFB2WithModifiers fail");
+			return -1;
+		}
+
+		info("drm: tiled framebuffer rejected, using linear buffers");
+		drm_dev.tiling = NULL;
+		drm_dev.linear_plane_id = drm_dev.plane_id;
+		drm_dev.linear_fourcc = drm_dev.fourcc;
+	}
+
 	ret = drmModeAddFB2(drm_dev.fd, drm_dev.width, drm_dev.height, drm_dev.fourcc,
 			    handles, pitches, offsets, &buf->fb_handle, 0);
 	if (ret) {
@@ -685,6 +1125,176 @@ static int drm_setup_buffers(void)
 	return 0;
 }
 
+#if LV_COLOR_DEPTH == 16
+/* Expand RGB565 pixels to opaque XRGB8888/ARGB8888 */
+static void drm_rgb565_to_xrgb8888(uint32_t *dst, const uint16_t *src, uint32_t w)
+{
+	uint32_t i = 0;
+	uint32_t p, r, g, b;
+
+#if defined(__SSE2__)
+	const __m128i mask5 = _mm_set1_epi16(0x1f);
+	const __m128i mask6 = _mm_set1_epi16(0x3f);
+	const __m128i alpha = _mm_set1_epi16((short)0xff00);
+	__m128i px, vr, vg, vb, bg, ra;
+
+	for (; i + 8 <= w; i += 8) {
+		px = _mm_loadu_si128((const __m128i *)(src + i));
+#if LV_COLOR_16_SWAP
+		px = _mm_or_si128(_mm_slli_epi16(px, 8), _mm_srli_epi16(px, 8));
+#endif
+		vr = _mm_srli_epi16(px, 11);
+		vg = _mm_and_si128(_mm_srli_epi16(px, 5), mask6);
+		vb = _mm_and_si128(px, mask5);
+
+		/* Replicate the top bits so that full intensity maps to 0xff */
+		vr = _mm_or_si128(_mm_slli_epi16(vr, 3), _mm_srli_epi16(vr, 2));
+		vg = _mm_or_si128(_mm_slli_epi16(vg, 2), _mm_srli_epi16(vg, 4));
+		vb = _mm_or_si128(_mm_slli_epi16(vb, 3), _mm_srli_epi16(vb, 2));
+
+		/* Interleave to B, G, R, A bytes (little endian XRGB8888) */
+		bg = _mm_or_si128(vb, _mm_slli_epi16(vg, 8));
+		ra = _mm_or_si128(vr, alpha);
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_unpacklo_epi16(bg, ra));
+		_mm_storeu_si128((__m128i *)(dst + i + 4), _mm_unpackhi_epi16(bg, ra));
+	}
+#elif defined(__ARM_NEON)
+	const uint16x8_t mask5 = vdupq_n_u16(0x1f);
+	const uint16x8_t mask6 = vdupq_n_u16(0x3f);
+	uint16x8_t px, vr, vg, vb;
+	uint8x8x4_t out;
+
+	out.val[3] = vdup_n_u8(0xff);
+
+	for (; i + 8 <= w; i += 8) {
+		px = vld1q_u16(src + i);
+#if LV_COLOR_16_SWAP
+		px = vreinterpretq_u16_u8(vrev16q_u8(vreinterpretq_u8_u16(px)));
+#endif
+		vr = vshrq_n_u16(px, 11);
+		vg = vandq_u16(vshrq_n_u16(px, 5), mask6);
+		vb = vandq_u16(px, mask5);
+
+		/* Replicate the top bits so that full intensity maps to 0xff */
+		vr = vorrq_u16(vshlq_n_u16(vr, 3), vshrq_n_u16(vr, 2));
+		vg = vorrq_u16(vshlq_n_u16(vg, 2), vshrq_n_u16(vg, 4));
+		vb = vorrq_u16(vshlq_n_u16(vb, 3), vshrq_n_u16(vb, 2));
+
+		/* Store interleaved B, G, R, A bytes (little endian XRGB8888) */
+		out.val[0] = vmovn_u16(vb);
+		out.val[1] = vmovn_u16(vg);
+		out.val[2] = vmovn_u16(vr);
+		vst4_u8((uint8_t *)(dst + i), out);
+	}
+#endif
+
+	for (; i < w; i++) {
+		p = src[i];
+#if LV_COLOR_16_SWAP
+		p = ((p & 0xff) << 8) | (p >> 8);
+#endif
+		r = (p >> 11) & 0x1f;
+		g = (p >> 5) & 0x3f;
+		b = p & 0x1f;
+		dst[i] = 0xff000000 | (((r << 3) | (r >> 2)) << 16) |
+			 (((g << 2) | (g >> 4)) << 8) | ((b << 3) | (b >> 2));
+	}
+}
+#endif
+
+/* Copy one row of the draw buffer to the framebuffer, converting if needed */
+static void drm_copy_row(void *dst, const lv_color_t *src, uint32_t w, uint32_t cpp)
+{
+#if LV_COLOR_DEPTH == 16
+	if (cpp == 4) {
+		drm_rgb565_to_xrgb8888(dst, (const uint16_t *)src, w);
+		return;
+	}
+#endif
+
+	memcpy(dst, src, w * cpp);
+}
+
+static void drm_destroy_dumb(struct drm_buffer *buf)
+{
+	struct drm_mode_destroy_dumb dreq;
+
+	if (buf->fb_handle)
+		drmModeRmFB(drm_dev.fd, buf->fb_handle);
+
+	if (buf->map && buf->map != MAP_FAILED)
+		munmap(buf->map, buf->size);
+
+	if (buf->handle) {
+		memset(&dreq, 0, sizeof(dreq));
+		dreq.handle = buf->handle;
+		drmIoctl(drm_dev.fd, DRM_IOCTL_MODE_DESTROY_DUMB, &dreq);
+	}
+
+	memset(buf, 0, sizeof(*buf));
+}
+
+static void drm_destroy_buffers(void)
+{
+	drm_destroy_dumb(&drm_dev.drm_bufs[0]);
+	drm_destroy_dumb(&drm_dev.drm_bufs[1]);
+
+	drm_dev.cur_bufs[0] = NULL;
+	drm_dev.cur_bufs[1] = NULL;
+}
+
+/*
+ * Copy `w` pixels of the draw buffer to (x, y) of a framebuffer with `cpp`
+ * bytes per pixel. Tiled layouts (`t` not NULL) are written one span at a time.
+ */
+static void drm_copy_row_to(const struct drm_tiling *t, void *map, uint32_t pitch, uint32_t cpp,
+			    uint32_t x, uint32_t y, const lv_color_t *src, uint32_t w)
+{
+	uint32_t xb, n;
+
+	if (!t) {
+		drm_copy_row((uint8_t *)map + (x * cpp) + (pitch * y), src, w, cpp);
+		return;
+	}
+
+	while (w) {
+		xb = x * cpp;
+		n = (t->span - xb % t->span) / cpp;
+		if (n > w)
+			n = w;
+
+		drm_copy_row((uint8_t *)map + drm_tile_offset(t, pitch, xb, y), src, n, cpp);
+
+		x += n;
+		src += n;
+		w -= n;
+	}
+}
+
+int drm_tile_image(uint64_t modifier, void *dst, uint32_t dst_pitch,
+		   const void *src, uint32_t src_pitch,
+		   uint32_t width, uint32_t height, uint32_t cpp)
+{
+	const struct drm_tiling *t = NULL;
+	uint32_t y;
+
+	/* The same conversions as drm_flush() */
+	if (cpp != sizeof(lv_color_t) && !(LV_COLOR_DEPTH == 16 && cpp == 4))
+		return -1;
+
+	if (modifier != DRM_FORMAT_MOD_LINEAR) {
+		t = drm_get_tiling(modifier);
+		if (!t || dst_pitch % t->tile_w || t->span % cpp)
+			return -1;
+	}
+
+	for (y = 0; y < height; y++)
+		drm_copy_row_to(t, dst, dst_pitch, cpp, 0, y,
+				(const lv_color_t *)((const uint8_t *)src + y * src_pitch), width);
+
+	return 0;
+}
+
 void drm_wait_vsync(lv_disp_drv_t *disp_drv)
 {
 	int ret;
@@ -719,15 +1329,20 @@ void drm_flush(lv_disp_drv_t *disp_drv, const lv_area_t *area, lv_color_t *color
 
 	dbg("x %d:%d y %d:%d w %d h %d", area->x1, area->x2, area->y1, area->y2, w, h);
 
+	/* Nothing is scanned out while blanked, redraw everything on wake */
+	if (!drm_dev.active) {
+		drm_dev.flush_skipped = 1;
+		lv_disp_flush_ready(disp_drv);
+		return;
+	}
+
 	/* Partial update */
 	if ((w != drm_dev.width || h != drm_dev.height) && drm_dev.cur_bufs[0])
 		memcpy(fbuf->map, drm_dev.cur_bufs[0]->map, fbuf->size);
 
-	for (y = 0, i = area->y1 ; i <= area->y2 ; ++i, ++y) {
-                memcpy((uint8_t *)fbuf->map + (area->x1 * (LV_COLOR_SIZE/8)) + (fbuf->pitch * i),
-                       (uint8_t *)color_p + (w * (LV_COLOR_SIZE/8) * y),
-		       w * (LV_COLOR_SIZE/8));
-	}
+	for (y = 0, i = area->y1 ; i <= area->y2 ; ++i, ++y)
+		drm_copy_row_to(drm_dev.tiling, fbuf->map, fbuf->pitch, drm_dev.cpp,
+				area->x1, i, color_p + (w * y), w);
 
 	if (drm_dev.req)
 		drm_wait_vsync(disp_drv);
@@ -750,14 +1365,311 @@ void drm_flush(lv_disp_drv_t *disp_drv, const lv_area_t *area, lv_color_t *color
 	lv_disp_flush_ready(disp_drv);
 }
 
-#if LV_COLOR_DEPTH == 32
-#define DRM_FOURCC DRM_FORMAT_ARGB8888
-#elif LV_COLOR_DEPTH == 16
-#define DRM_FOURCC DRM_FORMAT_RGB565
-#else
-#error LV_COLOR_DEPTH not supported
+static lv_disp_t *drm_get_disp(void)
+{
+	lv_disp_t *disp = NULL;
+
+	while ((disp = lv_disp_get_next(disp)) != NULL) {
+		if (disp->driver->flush_cb == drm_flush)
+			return disp;
+	}
+
+	return NULL;
+}
+
+void drm_set_active(bool active)
+{
+	lv_disp_t *disp = drm_get_disp();
+	uint32_t prop_id;
+
+	if (drm_dev.fd < 0 || drm_dev.active == active)
+		return;
+
+	/* Stay blanked until a monitor is plugged in again */
+	if (active && !drm_dev.connected)
+		return;
+
+	/* Let the last page flip complete before touching the CRTC */
+	if (drm_dev.req)
+		drm_wait_vsync(NULL);
+
+	if (!active) {
+		drm_dev.dpms_legacy = 0;
+
+		if (drm_dmabuf_disable()) {
+			prop_id = get_conn_property_id("DPMS");
+			if (!prop_id || drmModeConnectorSetProperty(drm_dev.fd, drm_dev.conn_id,
+								    prop_id, DRM_MODE_DPMS_OFF)) {
+				err("drm: cannot blank the display");
+				return;
+			}
+			drm_dev.dpms_legacy = 1;
+		}
+
+		drm_dev.active = 0;
+		drm_dev.flush_skipped = 0;
+
+		/* Stop rendering, invalidated areas are kept until wake */
+		if (disp && disp->refr_timer)
+			lv_timer_pause(disp->refr_timer);
+
+		dbg("blanked");
+		return;
+	}
+
+	if (drm_dev.dpms_legacy) {
+		prop_id = get_conn_property_id("DPMS");
+		drmModeConnectorSetProperty(drm_dev.fd, drm_dev.conn_id, prop_id, DRM_MODE_DPMS_ON);
+		drm_dev.dpms_legacy = 0;
+	} else {
+		/* Bring the CRTC back up with the last shown frame */
+		drm_dev.modeset = 1;
+		if (drm_dev.cur_bufs[0] && drm_dmabuf_set_plane(drm_dev.cur_bufs[0]))
+			err("drm: cannot unblank the display");
+	}
+
+	drm_dev.active = 1;
+
+	if (disp) {
+		if (drm_dev.flush_skipped)
+			lv_obj_invalidate(lv_disp_get_scr_act(disp));
+
+		if (disp->refr_timer)
+			lv_timer_resume(disp->refr_timer);
+	}
+	drm_dev.flush_skipped = 0;
+
+	dbg("unblanked");
+}
+
+bool drm_is_active(void)
+{
+	return drm_dev.active;
+}
+
+static void drm_idle_timer_cb(lv_timer_t *timer)
+{
+	lv_disp_t *disp = drm_get_disp();
+	uint32_t inactive;
+
+	(void)timer;
+
+	if (!disp)
+		return;
+
+	inactive = lv_disp_get_inactive_time(disp);
+
+	if (drm_dev.active && inactive >= drm_dev.idle_timeout)
+		drm_set_active(false);
+	else if (!drm_dev.active && inactive < drm_dev.idle_timeout)
+		drm_set_active(true);
+}
+
+void drm_set_idle_timeout(uint32_t timeout_ms)
+{
+	drm_dev.idle_timeout = timeout_ms;
+
+	if (!timeout_ms) {
+		if (drm_dev.idle_timer) {
+			lv_timer_del(drm_dev.idle_timer);
+			drm_dev.idle_timer = NULL;
+		}
+		drm_set_active(true);
+		return;
+	}
+
+	if (!drm_dev.idle_timer)
+		drm_dev.idle_timer = lv_timer_create(drm_idle_timer_cb, DRM_IDLE_CHECK_PERIOD, NULL);
+}
+
+#if DRM_HOTPLUG
+/* Check whether a kernel uevent reports a DRM hotplug: "KEY=value" strings separated by '\0' */
+static int drm_uevent_is_hotplug(const char *buf, size_t len)
+{
+	const char *end = buf + len;
+	int drm = 0, hotplug = 0;
+
+	while (buf < end) {
+		if (!strcmp(buf, "SUBSYSTEM=drm"))
+			drm = 1;
+		else if (!strcmp(buf, "HOTPLUG=1"))
+			hotplug = 1;
+
+		buf += strnlen(buf, end - buf) + 1;
+	}
+
+	return drm && hotplug;
+}
+
+void drm_hotplug_dispatch(void)
+{
+	char buf[2048];
+	ssize_t len;
+	int hotplug = 0;
+
+	if (drm_dev.hotplug_fd < 0)
+		return;
+
+	/* Drain the socket, a single re-probe covers all queued events */
+	while ((len = recv(drm_dev.hotplug_fd, buf, sizeof(buf) - 1, MSG_DONTWAIT)) > 0) {
+		buf[len] = '\0';
+		if (drm_uevent_is_hotplug(buf, len))
+			hotplug = 1;
+	}
+
+	if (hotplug)
+		drm_handle_hotplug();
+}
+
+#if DRM_HOTPLUG_POLL_PERIOD
+static void drm_hotplug_timer_cb(lv_timer_t *timer)
+{
+	(void)timer;
+
+	drm_hotplug_dispatch();
+}
 #endif
 
+static int drm_hotplug_open(void)
+{
+	struct sockaddr_nl addr;
+	int fd;
+
+	fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+	if (fd < 0) {
+		err("cannot open uevent socket: %s", strerror(errno));
+		return -1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.nl_family = AF_NETLINK;
+	addr.nl_groups = 1; /* kernel uevents */
+
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		err("cannot bind uevent socket: %s", strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	drm_dev.hotplug_fd = fd;
+#if DRM_HOTPLUG_POLL_PERIOD
+	drm_dev.hotplug_timer = lv_timer_create(drm_hotplug_timer_cb, DRM_HOTPLUG_POLL_PERIOD, NULL);
+#endif
+
+	return 0;
+}
+
+static void drm_hotplug_close(void)
+{
+	if (drm_dev.hotplug_timer) {
+		lv_timer_del(drm_dev.hotplug_timer);
+		drm_dev.hotplug_timer = NULL;
+	}
+
+	if (drm_dev.hotplug_fd >= 0) {
+		close(drm_dev.hotplug_fd);
+		drm_dev.hotplug_fd = -1;
+	}
+}
+#else
+void drm_hotplug_dispatch(void)
+{
+}
+#endif /*DRM_HOTPLUG*/
+
+int drm_get_hotplug_fd(void)
+{
+	return drm_dev.hotplug_fd;
+}
+
+void drm_handle_hotplug(void)
+{
+	lv_disp_t *disp = drm_get_disp();
+	drmModeConnector *conn;
+	uint32_t old_conn_id = drm_dev.conn_id;
+	uint32_t old_crtc_id = drm_dev.crtc_id;
+	uint32_t old_fourcc = drm_dev.fourcc;
+	const struct drm_tiling *old_tiling = drm_dev.tiling;
+	uint32_t old_width = drm_dev.width;
+	uint32_t old_height = drm_dev.height;
+	drmModeModeInfo old_mode = drm_dev.mode;
+	int resized;
+
+	if (drm_dev.fd < 0)
+		return;
+
+	if (drm_dev.req)
+		drm_wait_vsync(NULL);
+
+	/*
+	 * With full_refresh or direct_mode LVGL renders whole frames into the
+	 * application's draw buffer, a larger mode than it holds can't be used.
+	 */
+	drm_dev.max_pixels = 0;
+	if (disp && (disp->driver->full_refresh || disp->driver->direct_mode))
+		drm_dev.max_pixels = disp->driver->draw_buf->size;
+
+	/* Blank while the old objects are still known if the monitor went away */
+	if (drm_dev.connected) {
+		conn = drmModeGetConnector(drm_dev.fd, drm_dev.conn_id);
+		if (!conn || conn->connection != DRM_MODE_CONNECTED || conn->count_modes <= 0) {
+			info("drm: connector %u lost", drm_dev.conn_id);
+			drm_set_active(false);
+			drm_dev.connected = 0;
+		}
+
+		if (conn)
+			drmModeFreeConnector(conn);
+	}
+
+	if (drm_probe())
+		return;
+
+	/* A different connector took over, the old one must let go of the CRTC */
+	if (drm_dev.conn_id != old_conn_id)
+		drm_dev.detach_conn_id = old_conn_id;
+
+	if (drm_dev.connected && drm_dev.conn_id == old_conn_id &&
+	    drm_dev.crtc_id == old_crtc_id && drm_dev.fourcc == old_fourcc &&
+	    drm_dev.tiling == old_tiling && drm_mode_equal(&drm_dev.mode, &old_mode)) {
+		dbg("hotplug: nothing changed");
+		return;
+	}
+
+	resized = drm_dev.width != old_width || drm_dev.height != old_height;
+
+	if (resized || drm_dev.fourcc != old_fourcc || drm_dev.tiling != old_tiling) {
+		drm_destroy_buffers();
+		if (drm_setup_buffers()) {
+			err("DRM buffer allocation failed");
+			return;
+		}
+	}
+
+	drm_dev.modeset = 1;
+
+	if (!drm_dev.connected) {
+		drm_dev.connected = 1;
+		drm_set_active(true);
+	} else if (drm_dev.active && drm_dev.cur_bufs[0]) {
+		/* Same buffers, just route them to the new connector/mode */
+		if (drm_dmabuf_set_plane(drm_dev.cur_bufs[0]))
+			err("drm: cannot show the frame after hotplug");
+	}
+
+	if (!disp)
+		return;
+
+	if (resized) {
+		info("drm: resolution changed to %ux%u", drm_dev.width, drm_dev.height);
+		disp->driver->hor_res = drm_dev.width;
+		disp->driver->ver_res = drm_dev.height;
+		lv_disp_drv_update(disp, disp->driver);
+	} else {
+		lv_obj_invalidate(lv_disp_get_scr_act(disp));
+	}
+}
+
 void drm_get_sizes(lv_coord_t *width, lv_coord_t *height, uint32_t *dpi)
 {
 	if (width)
@@ -774,7 +1686,9 @@ void drm_init(void)
 {
 	int ret;
 
-	ret = drm_setup(DRM_FOURCC);
+	drm_dev.hotplug_fd = -1;
+
+	ret = drm_setup();
 	if (ret) {
 		close(drm_dev.fd);
 		drm_dev.fd = -1;
@@ -789,11 +1703,28 @@ void drm_init(void)
 		return;
 	}
 
+	drm_dev.modeset = 1;
+	drm_dev.active = 1;
+	drm_dev.connected = 1;
+
+#if DRM_HOTPLUG
+	drm_hotplug_open();
+#endif
+
 	info("DRM subsystem and buffer mapped successfully");
 }
 
 void drm_exit(void)
 {
+#if DRM_HOTPLUG
+	drm_hotplug_close();
+#endif
+
+	if (drm_dev.idle_timer) {
+		lv_timer_del(drm_dev.idle_timer);
+		drm_dev.idle_timer = NULL;
+	}
+
 	close(drm_dev.fd);
 	drm_dev.fd = -1;
 }
@@ -46,6 +46,65 @@ void drm_exit(void);
 void drm_flush(lv_disp_drv_t * drv, const lv_area_t * area, lv_color_t * color_p);
 void drm_wait_vsync(lv_disp_drv_t * drv);
 
+/**
+ * Blank or unblank the display. While blanked the CRTC is switched off, the
+ * plane is detached and the refresh timer of the DRM display is paused.
+ * @param active false to blank, true to scan out again
+ */
+void drm_set_active(bool active);
+
+/**
+ * Tell whether the display is scanning out
+ * @return false while blanked
+ */
+bool drm_is_active(void);
+
+/**
+ * Blank the display after a period without input and unblank it on the next input.
+ * @param timeout_ms inactivity time before blanking, 0 to disable
+ */
+void drm_set_idle_timeout(uint32_t timeout_ms);
+
+/**
+ * Re-probe the connectors, e.g. after a monitor was plugged or unplugged.
+ * The buffers are re-created and the LVGL display resized if the mode changed.
+ * With `full_refresh` or `direct_mode` only modes fitting in the draw buffer are used.
+ * If the re-probe fails the previous connector and mode are kept.
+ */
+void drm_handle_hotplug(void);
+
+/**
+ * Get the uevent socket watched for hotplug events.
+ * Wait on it in the application's poll loop and call `drm_hotplug_dispatch()` when readable.
+ * @return file descriptor or -1 if hotplug detection is disabled
+ */
+int drm_get_hotplug_fd(void);
+
+/**
+ * Read the queued kernel uevents and call `drm_handle_hotplug()` on a DRM hotplug.
+ * Called from an LVGL timer if `DRM_HOTPLUG_POLL_PERIOD` is not 0.
+ */
+void drm_hotplug_dispatch(void);
+
+/**
+ * Copy an image into the layout of a DRM format modifier with the row copy of `drm_flush()`.
+ * Can be used offline, e.g. to prepare images or to benchmark the layouts (see tools/drm_tile_bench).
+ * Bit 6 address swizzling is not applied.
+ * @param modifier DRM_FORMAT_MOD_LINEAR or a tiled modifier known by the driver
+ *                 (I915_FORMAT_MOD_X_TILED, I915_FORMAT_MOD_Y_TILED)
+ * @param dst the framebuffer, `dst_pitch * height` bytes, rounded up to whole tiles if tiled
+ * @param dst_pitch bytes per row of the framebuffer, multiple of the tile width if tiled
+ * @param src the image in `lv_color_t` pixels
+ * @param src_pitch bytes per row of the image
+ * @param width width of the image in pixels
+ * @param height height of the image in pixels
+ * @param cpp bytes per pixel of the framebuffer: `sizeof(lv_color_t)`, or 4 to convert RGB565 to XRGB8888
+ * @return 0 on success, -1 if the modifier, the pitch or `cpp` is not supported
+ */
+int drm_tile_image(uint64_t modifier, void * dst, uint32_t dst_pitch,
+                   const void * src, uint32_t src_pitch,
+                   uint32_t width, uint32_t height, uint32_t cpp);
+
 
 /**********************
  *      MACROS
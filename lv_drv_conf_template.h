@@ -89,16 +89,40 @@
 #endif
 
 #if USE_SDL
+/* Size of the windows opened for displays with `flush_cb = sdl_display_flush`.
+ * Use `sdl_window_create()` to open any number of windows with other sizes*/
 #  define SDL_HOR_RES     480
 #  define SDL_VER_RES     320
 
-/* Scale window by this factor (useful when simulating small screens) */
+/* Initial scale of the windows (useful when simulating small screens).
+ * Can be fractional, e.g. 1.5. The windows can be resized at runtime too*/
 #  define SDL_ZOOM        1
 
 /* Used to test true double buffering with only address changing.
- * Use 2 draw buffers, bith with SDL_HOR_RES x SDL_VER_RES size*/
+ * Use 2 draw buffers, bith with SDL_HOR_RES x SDL_VER_RES size
+ * and enable `direct_mode` or `full_refresh` in the display driver*/
 #  define SDL_DOUBLE_BUFFERED 0
 
+/* Present with a GPU accelerated renderer synchronized to vsync.
+ * Falls back to the software renderer if no accelerated one is available*/
+#  define SDL_ACCELERATED 0
+
+/* Don't open any window, only keep the frame buffer in memory.
+ * Read it with `sdl_get_fb()`, `sdl_fb_hash()`, `sdl_fb_save_ppm()` or `sdl_fb_save_png()`*/
+#  define SDL_HEADLESS    0
+
+/* Where LVGL's time comes from:
+ * - SDL_TICK_THREAD: a thread calls `lv_tick_inc()` every few milliseconds
+ * - SDL_TICK_MONOTONIC: no thread, set `LV_TICK_CUSTOM 1` and
+ *   `LV_TICK_CUSTOM_SYS_TIME_EXPR (sdl_tick_get())` in lv_conf.h
+ * - SDL_TICK_VIRTUAL: time stands still until `sdl_tick_advance()` is called*/
+#  define SDL_TICK_SOURCE SDL_TICK_THREAD
+
+/* Measure the time of rendering, uploading and presenting each frame.
+ * The frame rate and percentiles are shown in the window title,
+ * see also `sdl_frame_stats_get()` and `sdl_frame_stats_csv()`*/
+#  define SDL_FRAME_STATS 0
+
 /*Eclipse: <SDL2/SDL.h>    Visual Studio: <SDL.h>*/
 #  define SDL_INCLUDE_PATH    <SDL2/SDL.h>
 
@@ -175,6 +199,11 @@
 #  define WAYLAND_HOR_RES      480
 #  define WAYLAND_VER_RES      320
 #  define WAYLAND_SURF_TITLE   "LVGL"
+#  define WAYLAND_BUF_CNT      2    /*Number of shm buffers (2 or 3). The compositor may keep the shown one until the next is attached*/
+#  define WAYLAND_XDG_SHELL    0    /*1: use xdg-shell if the compositor has it (needs the generated xdg-shell-client-protocol.h, see wayland/README.md)*/
+#  define WAYLAND_DMABUF       0    /*1: pass the buffers as dma-bufs via /dev/udmabuf if the compositor supports it (see wayland/README.md)*/
+#  define WAYLAND_DISPATCH_THREAD 1 /*0: no thread and locks, the events are read in `lv_timer_handler()` or `wayland_dispatch()`*/
+#  define WAYLAND_INPUT_QUEUE_SIZE 32 /*Presses and releases buffered per input device between two reads*/
 #endif
 
 /*----------------
@@ -329,6 +358,10 @@
 #if USE_DRM
 #  define DRM_CARD          "/dev/dri/card0"
 #  define DRM_CONNECTOR_ID  -1	/* -1 for the first connected one */
+#  define DRM_HOTPLUG       0	/* Re-probe the connector on kernel hotplug events */
+#  define DRM_HOTPLUG_POLL_PERIOD 0	/* Check for uevents from an LVGL timer (ms), 0 if the application waits on drm_get_hotplug_fd() */
+#  define DRM_USE_MODIFIERS 0	/* Use tiled buffers if the plane supports a known modifier (no bit 6 swizzling) */
+#  define DRM_SEAMLESS_STARTUP 0	/* Skip the startup modeset if the bootloader already set the same mode */
 #endif
 
 /*********************
@@ -42,47 +42,238 @@
 
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include <string.h>
 #include SDL_INCLUDE_PATH
 
+#if LV_COLOR_DEPTH == 16 && LV_COLOR_16_SWAP
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+#endif
+
 /*********************
  *      DEFINES
  *********************/
 #define SDL_REFR_PERIOD     50  /*ms*/
 
-#ifndef KEYBOARD_BUFFER_SIZE
-#define KEYBOARD_BUFFER_SIZE SDL_TEXTINPUTEVENT_TEXT_SIZE
+/*Texture format matching the LVGL colors so rows can be copied as they are*/
+#if LV_COLOR_DEPTH == 32 || LV_COLOR_DEPTH == 24    /*32 is valid but support 24 for backward compatibility too*/
+#define SDL_FB_FORMAT       SDL_PIXELFORMAT_ARGB8888
+#define SDL_FB_PX_SIZE      4
+#elif LV_COLOR_DEPTH == 16
+#define SDL_FB_FORMAT       SDL_PIXELFORMAT_RGB565
+#define SDL_FB_PX_SIZE      2
+#elif LV_COLOR_DEPTH == 8
+#define SDL_FB_FORMAT       SDL_PIXELFORMAT_RGB332
+#define SDL_FB_PX_SIZE      1
+#else
+#define SDL_FB_FORMAT       SDL_PIXELFORMAT_ARGB8888
+#define SDL_FB_PX_SIZE      4
+#endif
+
+#if SDL_DOUBLE_BUFFERED && (LV_COLOR_DEPTH == 1 || (LV_COLOR_DEPTH == 16 && LV_COLOR_16_SWAP))
+#error "SDL_DOUBLE_BUFFERED shows the draw buffers directly, it can't be used with LV_COLOR_DEPTH 1 or LV_COLOR_16_SWAP"
+#endif
+
+#ifndef SDL_ZOOM
+#define SDL_ZOOM            1.0f
+#endif
+
+#ifndef SDL_ACCELERATED
+#define SDL_ACCELERATED     0
+#endif
+
+#ifndef SDL_HEADLESS
+#define SDL_HEADLESS        0
+#endif
+
+#ifndef SDL_TICK_SOURCE
+#define SDL_TICK_SOURCE     SDL_TICK_THREAD
+#endif
+
+#if SDL_TICK_SOURCE == SDL_TICK_MONOTONIC && LV_TICK_CUSTOM == 0
+#error "SDL_TICK_MONOTONIC needs LV_TICK_CUSTOM 1 and LV_TICK_CUSTOM_SYS_TIME_EXPR (sdl_tick_get())"
 #endif
 
+/*Longest sleep in `sdl_timer_handler()` if no LVGL timer is due*/
+#define SDL_WAIT_MAX        500 /*ms*/
+
+/*Dirty areas kept between two presents before they are merged into one*/
+#define SDL_DIRTY_AREA_CNT  16
+
+/*Key events waiting to be read per window. Must be a power of 2*/
+#ifndef SDL_KEY_BUF_SIZE
+#define SDL_KEY_BUF_SIZE    64
+#endif
+
+#if (SDL_KEY_BUF_SIZE & (SDL_KEY_BUF_SIZE - 1)) != 0
+#error "SDL_KEY_BUF_SIZE must be a power of 2"
+#endif
+
+/*Fingers tracked at once per window*/
+#ifndef SDL_TOUCH_MAX
+#define SDL_TOUCH_MAX       5
+#endif
+
+#ifndef SDL_FRAME_STATS
+#define SDL_FRAME_STATS     0
+#endif
+
+/*Frames kept for the rolling statistics*/
+#define SDL_FRAME_STATS_CNT 120
+
+/*Input recording file: magic, version, then SDL_REC_SIZE byte little endian records*/
+#define SDL_REC_MAGIC       "LVIR"
+#define SDL_REC_VERSION     1
+#define SDL_REC_SIZE        12
+
+/*A key event is a Unicode code point (or LV_KEY_...) and this flag if pressed*/
+#define SDL_KEY_PRESSED     0x80000000u
+#define SDL_KEY_CODE_MASK   0x001FFFFFu
+
 /**********************
  *      TYPEDEFS
  **********************/
+/*Single producer, single consumer queue of key events*/
+typedef struct {
+    uint32_t ev[SDL_KEY_BUF_SIZE];
+    SDL_atomic_t head;  /*Written only by the producer*/
+    SDL_atomic_t tail;  /*Written only by the consumer*/
+} key_ring_t;
+
+#if SDL_FRAME_STATS
+/*Time spent in each stage of a frame in microseconds*/
+typedef struct {
+    uint32_t render;    /*LVGL rendering, i.e. outside of the flushes*/
+    uint32_t flush;     /*Copying the flushed areas to the frame buffer*/
+    uint32_t upload;    /*Uploading the dirty areas to the texture*/
+    uint32_t copy;      /*SDL_RenderCopy*/
+    uint32_t present;   /*SDL_RenderPresent*/
+} frame_time_t;
+#endif
+
+/*Recorded input events*/
+typedef enum {
+    SDL_REC_MOUSE,      /*data: x | y << 16, pressed: left button*/
+    SDL_REC_WHEEL,      /*data: encoder difference*/
+    SDL_REC_WHEEL_BTN,  /*pressed: middle button*/
+    SDL_REC_KEY,        /*data: key event as in the key queue*/
+} rec_type_t;
+
+typedef struct {
+    uint32_t time;      /*Milliseconds since the start of the recording*/
+    uint8_t type;
+    uint8_t window;     /*Index of the window in creation order*/
+    uint8_t pressed;
+    uint32_t data;
+} rec_event_t;
+
 typedef struct {
+    SDL_FingerID id;
+    lv_point_t point;
+    bool active;
+} touch_slot_t;
+
+typedef struct _monitor_t {
+    struct _monitor_t * next;
+    lv_disp_drv_t * disp_drv;
+    uint8_t index;
     SDL_Window * window;
     SDL_Renderer * renderer;
     SDL_Texture * texture;
-    volatile bool sdl_refr_qry;
-#if SDL_DOUBLE_BUFFERED
-    uint32_t * tft_fb_act;
-#else
-    uint32_t * tft_fb;
+    uint32_t window_id;
+    lv_coord_t hor_res;
+    lv_coord_t ver_res;
+    float zoom;
+    bool scale_sharp;   /*The texture is scaled by an integer factor, filtered with nearest neighbour*/
+    SDL_Rect dirty[SDL_DIRTY_AREA_CNT];
+    uint32_t dirty_cnt;
+    const uint8_t * tft_fb_act;    /*The pixels to show: `tft_fb` or a draw buffer*/
+    uint8_t * tft_fb;               /*Copy of the flushed areas, allocated when needed*/
+
+    /*Input received in this window*/
+    bool left_button_down;
+    int16_t last_x;
+    int16_t last_y;
+    int16_t wheel_diff;
+    lv_indev_state_t wheel_state;
+    key_ring_t keys;
+    uint32_t last_key;
+    lv_indev_state_t key_state;
+    touch_slot_t touch[SDL_TOUCH_MAX];
+    lv_point_t touch_last;
+    sdl_gesture_t gesture;
+
+#if SDL_FRAME_STATS
+    frame_time_t frames[SDL_FRAME_STATS_CNT];
+    uint64_t frame_end[SDL_FRAME_STATS_CNT];    /*Performance counter at the end of the frames*/
+    uint32_t frame_cnt;                         /*All frames so far*/
+    frame_time_t cur;
+    bool in_frame;
+    uint64_t flush_end;
+    uint32_t title_time;
+    FILE * csv;
 #endif
 }monitor_t;
 
 /**********************
  *  STATIC PROTOTYPES
  **********************/
-static void window_create(monitor_t * m);
+static monitor_t * window_create(lv_disp_drv_t * disp_drv, lv_coord_t hor_res, lv_coord_t ver_res, float zoom);
 static void window_update(monitor_t * m);
+static void window_update_scale_mode(monitor_t * m);
+static void window_add_dirty(monitor_t * m, const lv_area_t * area);
+static void window_set_all_dirty(monitor_t * m);
+static void copy_row(uint8_t * dst, const lv_color_t * src, uint32_t w);
+static const uint8_t * window_get_fb(const monitor_t * m);
+static bool window_copy_area(monitor_t * m, const lv_disp_drv_t * disp_drv, const lv_area_t * area, const lv_color_t * color_p);
+#if SDL_DOUBLE_BUFFERED
+static void window_sync_buffers(monitor_t * m, lv_disp_drv_t * disp_drv);
+#endif
+static monitor_t * window_from_id(uint32_t id);
+static monitor_t * event_to_window(const SDL_Event * event);
+static monitor_t * drv_to_monitor(const lv_disp_drv_t * disp_drv);
+static monitor_t * disp_to_monitor(lv_disp_t * disp);
+static monitor_t * indev_to_monitor(lv_indev_drv_t * indev_drv);
+static void fb_px_to_rgb(const uint8_t * px, uint8_t * rgb);
+static uint32_t png_crc(uint32_t crc, const uint8_t * buf, uint32_t len);
+static void png_put32(uint8_t * p, uint32_t v);
+static bool png_chunk(FILE * f, const char * type, const uint8_t * data, uint32_t len);
 int quit_filter(void * userdata, SDL_Event * event);
 static void monitor_sdl_clean_up(void);
 static void sdl_event_handler(lv_timer_t * t);
-static void monitor_sdl_refr(lv_timer_t * t);
-static void mouse_handler(SDL_Event * event);
-static void mousewheel_handler(SDL_Event * event);
+static void sdl_process_event(SDL_Event * event);
+static void indev_read_ready(void);
+static bool touch_indev_exists(void);
+static void mouse_handler(monitor_t * m, SDL_Event * event);
+static void mousewheel_handler(monitor_t * m, SDL_Event * event);
 static uint32_t keycode_to_ctrl_key(SDL_Keycode sdl_key);
-static void keyboard_handler(SDL_Event * event);
+static void keyboard_handler(monitor_t * m, SDL_Event * event);
+static void touch_handler(monitor_t * m, SDL_Event * event);
+static touch_slot_t * touch_find(monitor_t * m, SDL_FingerID id);
+static touch_slot_t * touch_alloc(monitor_t * m);
+static touch_slot_t * touch_primary(monitor_t * m);
+static bool key_ring_push(key_ring_t * r, uint32_t ev);
+static bool key_ring_pop(key_ring_t * r, uint32_t * ev);
+static bool key_ring_is_empty(key_ring_t * r);
+static uint32_t utf8_decode(const char ** txt);
+static uint32_t utf8_pack(uint32_t cp);
+static void key_push(monitor_t * m, uint32_t ev);
+static void record_event(monitor_t * m, rec_type_t type, bool pressed, uint32_t data);
+static bool rec_event_read(FILE * f, rec_event_t * rec);
+static uint32_t replay_process(void);
+#if SDL_FRAME_STATS
+static uint32_t perf_us(uint64_t start);
+static void frame_stats_add(monitor_t * m);
+static void frame_stats_calc(monitor_t * m, sdl_frame_stats_t * stats);
+static int frame_time_cmp(const void * a, const void * b);
+#endif
+#if SDL_TICK_SOURCE == SDL_TICK_THREAD
 static int tick_thread(void *data);
+#endif
 
 /***********************
  *   GLOBAL PROTOTYPES
@@ -91,23 +282,23 @@ static int tick_thread(void *data);
 /**********************
  *  STATIC VARIABLES
  **********************/
-monitor_t monitor;
+static monitor_t * monitor_list;
+static uint8_t monitor_cnt;
 
-#if SDL_DUAL_DISPLAY
-monitor_t monitor2;
-#endif
+static FILE * record_file;
+static uint32_t record_start;
+static FILE * replay_file;
+static uint32_t replay_start;
+static rec_event_t replay_next;
+static bool replay_held;    /*A due button change waits until LVGL read the previous one*/
 
 static volatile bool sdl_inited = false;
 static volatile bool sdl_quit_qry = false;
+static lv_timer_t * event_timer;
 
-static bool left_button_down = false;
-static int16_t last_x = 0;
-static int16_t last_y = 0;
-
-static int16_t wheel_diff = 0;
-static lv_indev_state_t wheel_state = LV_INDEV_STATE_RELEASED;
-
-static char buf[KEYBOARD_BUFFER_SIZE];
+#if SDL_TICK_SOURCE == SDL_TICK_VIRTUAL
+static volatile uint32_t virtual_tick = 0;
+#endif
 
 /**********************
  *      MACROS
@@ -120,144 +311,207 @@ static char buf[KEYBOARD_BUFFER_SIZE];
 void sdl_init(void)
 {
     /*Initialize the SDL*/
+#if SDL_HEADLESS
+    SDL_Init(SDL_INIT_EVENTS);
+#else
     SDL_Init(SDL_INIT_VIDEO);
+#endif
 
     SDL_SetEventFilter(quit_filter, NULL);
 
-    window_create(&monitor);
-#if SDL_DUAL_DISPLAY
-    window_create(&monitor2);
-    int x, y;
-    SDL_GetWindowPosition(monitor2.window, &x, &y);
-    SDL_SetWindowPosition(monitor.window, x + (SDL_HOR_RES * SDL_ZOOM) / 2 + 10, y);
-    SDL_SetWindowPosition(monitor2.window, x - (SDL_HOR_RES * SDL_ZOOM) / 2 - 10, y);
-#endif
-
     sdl_inited = true;
 
+#if SDL_HEADLESS == 0
     SDL_StartTextInput();
+#endif
 
+#if SDL_TICK_SOURCE == SDL_TICK_THREAD
     /* Tick init.
      * You have to call 'lv_tick_inc()' in periodically to inform LittelvGL about
      * how much time were elapsed Create an SDL thread to do this*/
     SDL_CreateThread(tick_thread, "tick", NULL);
+#endif
 
-    lv_timer_create(sdl_event_handler, 10, NULL);
+    event_timer = lv_timer_create(sdl_event_handler, 10, NULL);
 }
 
 /**
- * Flush a buffer to the marked area
- * @param drv pointer to driver where this function belongs
- * @param area an area where to copy `color_p`
- * @param color_p an array of pixel to copy to the `area` part of the screen
+ * Open a window for a display driver.
+ * Sets `hor_res`, `ver_res` and `flush_cb` of the driver, so call it
+ * after `lv_disp_drv_init()` and before `lv_disp_drv_register()`.
+ * @param disp_drv pointer to the display driver to show in the window
+ * @param hor_res horizontal resolution of the display
+ * @param ver_res vertical resolution of the display
+ * @param zoom initial scale of the window, can be fractional. The window can be resized later.
+ * @return true on success
  */
-void sdl_display_flush(lv_disp_drv_t * disp_drv, const lv_area_t * area, lv_color_t * color_p)
+bool sdl_window_create(lv_disp_drv_t * disp_drv, lv_coord_t hor_res, lv_coord_t ver_res, float zoom)
 {
-    lv_coord_t hres = disp_drv->hor_res;
-    lv_coord_t vres = disp_drv->ver_res;
+    monitor_t * m = window_create(disp_drv, hor_res, ver_res, zoom);
+    if(m == NULL) return false;
 
-//    printf("x1:%d,y1:%d,x2:%d,y2:%d\n", area->x1, area->y1, area->x2, area->y2);
+    disp_drv->hor_res = hor_res;
+    disp_drv->ver_res = ver_res;
+    disp_drv->flush_cb = sdl_display_flush;
 
-    /*Return if the area is out the screen*/
-    if(area->x2 < 0 || area->y2 < 0 || area->x1 > hres - 1 || area->y1 > vres - 1) {
-        lv_disp_flush_ready(disp_drv);
-        return;
-    }
+    return true;
+}
 
-#if SDL_DOUBLE_BUFFERED
-    monitor.tft_fb_act = (uint32_t *)color_p;
-#else /*SDL_DOUBLE_BUFFERED*/
+/**
+ * Resize the window of a display
+ * @param disp pointer to an SDL display or NULL to use the default display
+ * @param zoom the new scale of the window, can be fractional
+ */
+void sdl_window_set_zoom(lv_disp_t * disp, float zoom)
+{
+    monitor_t * m = disp_to_monitor(disp);
+    if(m == NULL || zoom <= 0) return;
 
-    int32_t y;
-#if LV_COLOR_DEPTH != 24 && LV_COLOR_DEPTH != 32    /*32 is valid but support 24 for backward compatibility too*/
-    int32_t x;
-    for(y = area->y1; y <= area->y2 && y < disp_drv->ver_res; y++) {
-        for(x = area->x1; x <= area->x2; x++) {
-            monitor.tft_fb[y * disp_drv->hor_res + x] = lv_color_to32(*color_p);
-            color_p++;
-        }
+    m->zoom = zoom;
+#if SDL_HEADLESS == 0
+    SDL_SetWindowSize(m->window, (int)(m->hor_res * zoom + 0.5f), (int)(m->ver_res * zoom + 0.5f));
+    window_update_scale_mode(m);
+#endif
+}
 
+/**
+ * Call `lv_timer_handler()` and sleep until the next LVGL timer is due or an SDL event arrives.
+ * Use it in the main loop instead of `lv_timer_handler()` and a fixed delay:
+ * input is handled as soon as it arrives and the CPU stays idle between frames.
+ */
+void sdl_timer_handler(void)
+{
+    /*The events are handled here from now on, stop polling them*/
+    if(event_timer) {
+        lv_timer_pause(event_timer);
     }
+
+    uint32_t time_till_next = lv_timer_handler();
+
+    /*Wake up for the next replayed event too*/
+    time_till_next = LV_MIN(time_till_next, replay_process());
+
+#if SDL_TICK_SOURCE == SDL_TICK_VIRTUAL
+    /*The time doesn't pass while sleeping, only poll the events*/
+    time_till_next = 0;
 #else
-    uint32_t w = lv_area_get_width(area);
-    for(y = area->y1; y <= area->y2 && y < disp_drv->ver_res; y++) {
-        memcpy(&monitor.tft_fb[y * SDL_HOR_RES + area->x1], color_p, w * sizeof(lv_color_t));
-        color_p += w;
-    }
+    if(time_till_next > SDL_WAIT_MAX) time_till_next = SDL_WAIT_MAX;
 #endif
-#endif /*SDL_DOUBLE_BUFFERED*/
 
-    monitor.sdl_refr_qry = true;
+    SDL_Event event;
+    if(SDL_WaitEventTimeout(&event, time_till_next) == 0) return;
 
-    /* TYPICALLY YOU DO NOT NEED THIS
-     * If it was the last part to refresh update the texture of the window.*/
-    if(lv_disp_flush_is_last(disp_drv)) {
-        monitor_sdl_refr(NULL);
-    }
+    do {
+        sdl_process_event(&event);
+    } while(SDL_PollEvent(&event));
 
-    /*IMPORTANT! It must be called to tell the system the flush is ready*/
-    lv_disp_flush_ready(disp_drv);
+    /*Read the new input on the next `lv_timer_handler()` instead of waiting for the read period*/
+    indev_read_ready();
 
+    if(sdl_quit_qry) {
+        monitor_sdl_clean_up();
+        exit(0);
+    }
 }
 
-
-#if SDL_DUAL_DISPLAY
-
 /**
  * Flush a buffer to the marked area
  * @param drv pointer to driver where this function belongs
  * @param area an area where to copy `color_p`
  * @param color_p an array of pixel to copy to the `area` part of the screen
  */
-void sdl_display_flush2(lv_disp_drv_t * disp_drv, const lv_area_t * area, lv_color_t * color_p)
+void sdl_display_flush(lv_disp_drv_t * disp_drv, const lv_area_t * area, lv_color_t * color_p)
 {
     lv_coord_t hres = disp_drv->hor_res;
     lv_coord_t vres = disp_drv->ver_res;
 
+    /*For backward compatibility: open a window for drivers not set up with `sdl_window_create()`*/
+    monitor_t * m = drv_to_monitor(disp_drv);
+    if(m == NULL) {
+        m = window_create(disp_drv, hres, vres, SDL_ZOOM);
+        if(m == NULL) {
+            lv_disp_flush_ready(disp_drv);
+            return;
+        }
+    }
+
     /*Return if the area is out the screen*/
     if(area->x2 < 0 || area->y2 < 0 || area->x1 > hres - 1 || area->y1 > vres - 1) {
         lv_disp_flush_ready(disp_drv);
         return;
     }
 
-#if SDL_DOUBLE_BUFFERED
-    monitor2.tft_fb_act = (uint32_t *)color_p;
-
-    monitor2.sdl_refr_qry = true;
-
-    /*IMPORTANT! It must be called to tell the system the flush is ready*/
-    lv_disp_flush_ready(disp_drv);
-#else
-
-    int32_t y;
-#if LV_COLOR_DEPTH != 24 && LV_COLOR_DEPTH != 32    /*32 is valid but support 24 for backward compatibility too*/
-    int32_t x;
-    for(y = area->y1; y <= area->y2 && y < disp_drv->ver_res; y++) {
-        for(x = area->x1; x <= area->x2; x++) {
-            monitor2.tft_fb[y * disp_drv->hor_res + x] = lv_color_to32(*color_p);
-            color_p++;
-        }
-
+#if SDL_FRAME_STATS
+    uint64_t flush_start = SDL_GetPerformanceCounter();
+    if(m->in_frame) {
+        m->cur.render += perf_us(m->flush_end);
     }
-#else
-    uint32_t w = lv_area_get_width(area);
-    for(y = area->y1; y <= area->y2 && y < disp_drv->ver_res; y++) {
-        memcpy(&monitor2.tft_fb[y * disp_drv->hor_res + area->x1], color_p, w * sizeof(lv_color_t));
-        color_p += w;
+    else {
+        /*Rendering the first area started when the refresh timer ran*/
+        memset(&m->cur, 0, sizeof(m->cur));
+        lv_disp_t * disp = _lv_refr_get_disp_refreshing();
+        if(disp && disp->refr_timer) m->cur.render = lv_tick_elaps(disp->refr_timer->last_run) * 1000;
+        m->in_frame = true;
     }
 #endif
 
-    monitor2.sdl_refr_qry = true;
+    window_add_dirty(m, area);
+
+#if SDL_DOUBLE_BUFFERED
+    /*With full screen draw buffers show the draw buffer itself, only the damaged areas are uploaded*/
+    if(disp_drv->direct_mode || disp_drv->full_refresh) {
+        m->tft_fb_act = (const uint8_t *)color_p;
+    }
+    else
+#endif
+    {
+        if(!window_copy_area(m, disp_drv, area, color_p)) {
+            lv_disp_flush_ready(disp_drv);
+            return;
+        }
+        m->tft_fb_act = m->tft_fb;
+    }
 
     /* TYPICALLY YOU DO NOT NEED THIS
      * If it was the last part to refresh update the texture of the window.*/
     if(lv_disp_flush_is_last(disp_drv)) {
-        monitor_sdl_refr(NULL);
+#if SDL_DOUBLE_BUFFERED
+        window_sync_buffers(m, disp_drv);
+#endif
+#if SDL_FRAME_STATS
+        m->cur.flush += perf_us(flush_start);
+#endif
+        window_update(m);
+#if SDL_FRAME_STATS
+        frame_stats_add(m);
+        m->in_frame = false;
+#endif
+    }
+#if SDL_FRAME_STATS
+    else {
+        m->cur.flush += perf_us(flush_start);
     }
+    m->flush_end = SDL_GetPerformanceCounter();
+#endif
 
     /*IMPORTANT! It must be called to tell the system the flush is ready*/
     lv_disp_flush_ready(disp_drv);
-#endif
+
+}
+
+
+#if SDL_DUAL_DISPLAY
+
+/**
+ * Flush a buffer to the marked area
+ * @param drv pointer to driver where this function belongs
+ * @param area an area where to copy `color_p`
+ * @param color_p an array of pixel to copy to the `area` part of the screen
+ */
+void sdl_display_flush2(lv_disp_drv_t * disp_drv, const lv_area_t * area, lv_color_t * color_p)
+{
+    /*Every window has its own context now, only kept for backward compatibility*/
+    sdl_display_flush(disp_drv, area, color_p);
 }
 #endif
 
@@ -269,12 +523,22 @@ void sdl_display_flush2(lv_disp_drv_t * disp_drv, const lv_area_t * area, lv_col
  */
 void sdl_mouse_read(lv_indev_drv_t * indev_drv, lv_indev_data_t * data)
 {
-    (void) indev_drv;      /*Unused*/
+    monitor_t * m = indev_to_monitor(indev_drv);
+    if(m == NULL) {
+        data->state = LV_INDEV_STATE_RELEASED;
+        return;
+    }
 
     /*Store the collected data*/
-    data->point.x = last_x;
-    data->point.y = last_y;
-    data->state = left_button_down ? LV_INDEV_STATE_PRESSED : LV_INDEV_STATE_RELEASED;
+    data->point.x = m->last_x;
+    data->point.y = m->last_y;
+    data->state = m->left_button_down ? LV_INDEV_STATE_PRESSED : LV_INDEV_STATE_RELEASED;
+
+    /*This state is read now, replay the held back press or release and read it too*/
+    if(replay_held) {
+        replay_process();
+        data->continue_reading = true;
+    }
 }
 
 
@@ -285,11 +549,20 @@ void sdl_mouse_read(lv_indev_drv_t * indev_drv, lv_indev_data_t * data)
  */
 void sdl_mousewheel_read(lv_indev_drv_t * indev_drv, lv_indev_data_t * data)
 {
-    (void) indev_drv;      /*Unused*/
+    monitor_t * m = indev_to_monitor(indev_drv);
+    if(m == NULL) {
+        data->state = LV_INDEV_STATE_RELEASED;
+        return;
+    }
+
+    data->state = m->wheel_state;
+    data->enc_diff = m->wheel_diff;
+    m->wheel_diff = 0;
 
-    data->state = wheel_state;
-    data->enc_diff = wheel_diff;
-    wheel_diff = 0;
+    if(replay_held) {
+        replay_process();
+        data->continue_reading = true;
+    }
 }
 
 /**
@@ -299,205 +572,1149 @@ void sdl_mousewheel_read(lv_indev_drv_t * indev_drv, lv_indev_data_t * data)
  */
 void sdl_keyboard_read(lv_indev_drv_t * indev_drv, lv_indev_data_t * data)
 {
-    (void) indev_drv;      /*Unused*/
-
-    static bool dummy_read = false;
-    const size_t len = strlen(buf);
-
-    /*Send a release manually*/
-    if (dummy_read) {
-        dummy_read = false;
+    monitor_t * m = indev_to_monitor(indev_drv);
+    if(m == NULL) {
         data->state = LV_INDEV_STATE_RELEASED;
-        data->continue_reading = len > 0;
-    }
-    /*Send the pressed character*/
-    else if (len > 0) {
-        dummy_read = true;
-        data->state = LV_INDEV_STATE_PRESSED;
-        data->key = buf[0];
-        memmove(buf, buf + 1, len);
-        data->continue_reading = true;
+        return;
     }
-}
-
 
-/**********************
- *   STATIC FUNCTIONS
- **********************/
+    /*Send the next press or release, or keep the last state if there is nothing new*/
+    uint32_t ev;
+    if(key_ring_pop(&m->keys, &ev)) {
+        m->last_key = utf8_pack(ev & SDL_KEY_CODE_MASK);
+        m->key_state = (ev & SDL_KEY_PRESSED) ? LV_INDEV_STATE_PRESSED : LV_INDEV_STATE_RELEASED;
+    }
 
+    data->key = m->last_key;
+    data->state = m->key_state;
+    data->continue_reading = !key_ring_is_empty(&m->keys);
+}
 
 /**
- * SDL main thread. All SDL related task have to be handled here!
- * It initializes SDL, handles drawing and the mouse.
+ * Get the first finger touching the window as a pointer
+ * @param indev_drv pointer to the related input device driver
+ * @param data store the touch data here
  */
-
-static void sdl_event_handler(lv_timer_t * t)
+void sdl_touch_read(lv_indev_drv_t * indev_drv, lv_indev_data_t * data)
 {
-    (void)t;
+    monitor_t * m = indev_to_monitor(indev_drv);
+    if(m == NULL) {
+        data->state = LV_INDEV_STATE_RELEASED;
+        return;
+    }
 
-    /*Refresh handling*/
-    SDL_Event event;
-    while(SDL_PollEvent(&event)) {
-        mouse_handler(&event);
-        mousewheel_handler(&event);
-        keyboard_handler(&event);
+    touch_slot_t * slot = touch_primary(m);
+    if(slot) m->touch_last = slot->point;
 
-        if((&event)->type == SDL_WINDOWEVENT) {
-            switch((&event)->window.event) {
-#if SDL_VERSION_ATLEAST(2, 0, 5)
-                case SDL_WINDOWEVENT_TAKE_FOCUS:
-#endif
-                case SDL_WINDOWEVENT_EXPOSED:
-                    window_update(&monitor);
-#if SDL_DUAL_DISPLAY
-                    window_update(&monitor2);
-#endif
-                    break;
-                default:
-                    break;
-            }
+    data->point = m->touch_last;
+    data->state = slot ? LV_INDEV_STATE_PRESSED : LV_INDEV_STATE_RELEASED;
+}
+
+/**
+ * Get the position of every finger touching a display's window
+ * @param disp pointer to an SDL display or NULL to use the default display
+ * @param points store the points here
+ * @param max size of `points`
+ * @return number of points stored
+ */
+uint32_t sdl_touch_get_points(lv_disp_t * disp, lv_point_t * points, uint32_t max)
+{
+    monitor_t * m = disp_to_monitor(disp);
+    if(m == NULL) return 0;
+
+    uint32_t cnt = 0;
+    uint32_t i;
+    for(i = 0; i < SDL_TOUCH_MAX && cnt < max; i++) {
+        if(m->touch[i].active) {
+            points[cnt] = m->touch[i].point;
+            cnt++;
         }
     }
 
-    /*Run until quit event not arrives*/
-    if(sdl_quit_qry) {
-        monitor_sdl_clean_up();
-        exit(0);
-    }
+    return cnt;
 }
 
 /**
- * SDL main thread. All SDL related task have to be handled here!
- * It initializes SDL, handles drawing and the mouse.
+ * Get the pinch and rotation done on a display's window since the last call
+ * @param disp pointer to an SDL display or NULL to use the default display
+ * @param gesture store the gesture here
+ * @return true if there was a multi-finger gesture since the last call
  */
-
-static void monitor_sdl_refr(lv_timer_t * t)
+bool sdl_touch_get_gesture(lv_disp_t * disp, sdl_gesture_t * gesture)
 {
-    (void)t;
+    monitor_t * m = disp_to_monitor(disp);
+    if(m == NULL || m->gesture.finger_cnt == 0) return false;
 
-    /*Refresh handling*/
-    if(monitor.sdl_refr_qry != false) {
-        monitor.sdl_refr_qry = false;
-        window_update(&monitor);
-    }
+    *gesture = m->gesture;
 
-#if SDL_DUAL_DISPLAY
-    if(monitor2.sdl_refr_qry != false) {
-        monitor2.sdl_refr_qry = false;
-        window_update(&monitor2);
-    }
-#endif
+    /*The changes are reported only once, the center is kept*/
+    m->gesture.pinch = 0;
+    m->gesture.rotation = 0;
+    m->gesture.finger_cnt = 0;
+
+    return true;
 }
 
-int quit_filter(void * userdata, SDL_Event * event)
+/**
+ * Get the frame buffer of a display.
+ * Pixels are stored in the texture's format (ARGB8888, RGB565 or RGB332 depending on
+ * LV_COLOR_DEPTH) with a stride of the display's horizontal resolution.
+ * @param disp pointer to an SDL display or NULL to use the default display
+ * @return pointer to the frame buffer or NULL if nothing was rendered yet
+ */
+const void * sdl_get_fb(lv_disp_t * disp)
 {
-    (void)userdata;
+    monitor_t * m = disp_to_monitor(disp);
+    if(m == NULL) return NULL;
 
-    if(event->type == SDL_WINDOWEVENT) {
-        if(event->window.event == SDL_WINDOWEVENT_CLOSE) {
-            sdl_quit_qry = true;
-        }
-    }
-    else if(event->type == SDL_QUIT) {
-        sdl_quit_qry = true;
+    return window_get_fb(m);
+}
+
+/**
+ * Calculate the FNV-1a hash of a display's frame buffer to compare it with a known good frame.
+ * @param disp pointer to an SDL display or NULL to use the default display
+ * @return the hash or 0 if there is no frame buffer
+ */
+uint32_t sdl_fb_hash(lv_disp_t * disp)
+{
+    monitor_t * m = disp_to_monitor(disp);
+    if(m == NULL) return 0;
+
+    const uint8_t * fb = window_get_fb(m);
+    if(fb == NULL) return 0;
+
+    uint32_t hash = 2166136261u;
+    uint32_t size = (uint32_t)m->hor_res * m->ver_res * SDL_FB_PX_SIZE;
+    uint32_t i;
+    for(i = 0; i < size; i++) {
+        hash ^= fb[i];
+        hash *= 16777619u;
     }
 
-    return 1;
+    return hash;
 }
 
-static void monitor_sdl_clean_up(void)
+/**
+ * Save a display's frame buffer as a binary PPM image
+ * @param disp pointer to an SDL display or NULL to use the default display
+ * @param path path of the file to write
+ * @return true on success
+ */
+bool sdl_fb_save_ppm(lv_disp_t * disp, const char * path)
 {
-    SDL_DestroyTexture(monitor.texture);
-    SDL_DestroyRenderer(monitor.renderer);
-    SDL_DestroyWindow(monitor.window);
+    monitor_t * m = disp_to_monitor(disp);
+    if(m == NULL) return false;
 
-#if SDL_DUAL_DISPLAY
-    SDL_DestroyTexture(monitor2.texture);
-    SDL_DestroyRenderer(monitor2.renderer);
-    SDL_DestroyWindow(monitor2.window);
+    const uint8_t * fb = window_get_fb(m);
+    if(fb == NULL) return false;
 
-#endif
+    uint8_t * row = malloc(m->hor_res * 3);
+    if(row == NULL) return false;
 
-    SDL_Quit();
-}
+    FILE * f = fopen(path, "wb");
+    if(f == NULL) {
+        LV_LOG_ERROR("can't open %s", path);
+        free(row);
+        return false;
+    }
 
-static void window_create(monitor_t * m)
-{
-    m->window = SDL_CreateWindow("TFT Simulator",
-                              SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
-                              SDL_HOR_RES * SDL_ZOOM, SDL_VER_RES * SDL_ZOOM, 0);       /*last param. SDL_WINDOW_BORDERLESS to hide borders*/
+    fprintf(f, "P6\n%d %d\n255\n", m->hor_res, m->ver_res);
 
-    m->renderer = SDL_CreateRenderer(m->window, -1, SDL_RENDERER_SOFTWARE);
-    m->texture = SDL_CreateTexture(m->renderer,
-                                SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC, SDL_HOR_RES, SDL_VER_RES);
-    SDL_SetTextureBlendMode(m->texture, SDL_BLENDMODE_BLEND);
+    int32_t x, y;
+    bool ok = true;
+    for(y = 0; y < m->ver_res && ok; y++) {
+        for(x = 0; x < m->hor_res; x++) {
+            fb_px_to_rgb(fb, &row[x * 3]);
+            fb += SDL_FB_PX_SIZE;
+        }
+        ok = fwrite(row, m->hor_res * 3, 1, f) == 1;
+    }
 
-    /*Initialize the frame buffer to gray (77 is an empirical value) */
-#if SDL_DOUBLE_BUFFERED
-    SDL_UpdateTexture(m->texture, NULL, m->tft_fb_act, SDL_HOR_RES * sizeof(uint32_t));
-#else
-    m->tft_fb = (uint32_t *)malloc(sizeof(uint32_t) * SDL_HOR_RES * SDL_VER_RES);
-    memset(m->tft_fb, 0x44, SDL_HOR_RES * SDL_VER_RES * sizeof(uint32_t));
-#endif
+    if(fclose(f) != 0) ok = false;
+    if(!ok) LV_LOG_ERROR("can't write %s", path);
 
-    m->sdl_refr_qry = true;
+    free(row);
 
+    return ok;
 }
 
-static void window_update(monitor_t * m)
+/**
+ * Save a display's frame buffer as an RGB PNG image.
+ * The pixels are stored without compression, so no zlib or libpng is needed.
+ * @param disp pointer to an SDL display or NULL to use the default display
+ * @param path path of the file to write
+ * @return true on success
+ */
+bool sdl_fb_save_png(lv_disp_t * disp, const char * path)
 {
-#if SDL_DOUBLE_BUFFERED == 0
-    SDL_UpdateTexture(m->texture, NULL, m->tft_fb, SDL_HOR_RES * sizeof(uint32_t));
-#else
-    if(m->tft_fb_act == NULL) return;
-    SDL_UpdateTexture(m->texture, NULL, m->tft_fb_act, SDL_HOR_RES * sizeof(uint32_t));
-#endif
-    SDL_RenderClear(m->renderer);
-#if LV_COLOR_SCREEN_TRANSP
-    SDL_SetRenderDrawColor(m->renderer, 0xff, 0, 0, 0xff);
-    SDL_Rect r;
-    r.x = 0; r.y = 0; r.w = SDL_HOR_RES; r.h = SDL_VER_RES;
-    SDL_RenderDrawRect(m->renderer, &r);
-#endif
+    monitor_t * m = disp_to_monitor(disp);
+    if(m == NULL) return false;
+
+    const uint8_t * fb = window_get_fb(m);
+    if(fb == NULL) return false;
+
+    /*A row is a filter type byte and the pixels, split into "stored" deflate blocks of max. 64 kB*/
+    uint32_t row_len = 1 + m->hor_res * 3;
+    uint32_t block_cnt = (row_len + 0xffff - 1) / 0xffff;
+    uint8_t * row = malloc(row_len);
+    uint8_t * idat = malloc(2 + block_cnt * 5 + row_len + 4);
+    if(row == NULL || idat == NULL) {
+        free(row);
+        free(idat);
+        return false;
+    }
 
-    /*Update the renderer with the texture containing the rendered image*/
-    SDL_RenderCopy(m->renderer, m->texture, NULL, NULL);
-    SDL_RenderPresent(m->renderer);
-}
+    FILE * f = fopen(path, "wb");
+    if(f == NULL) {
+        LV_LOG_ERROR("can't open %s", path);
+        free(row);
+        free(idat);
+        return false;
+    }
 
-static void mouse_handler(SDL_Event * event)
-{
-    switch(event->type) {
-        case SDL_MOUSEBUTTONUP:
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    uint8_t ihdr[13];
+    png_put32(&ihdr[0], m->hor_res);
+    png_put32(&ihdr[4], m->ver_res);
+    ihdr[8] = 8;    /*Bit depth*/
+    ihdr[9] = 2;    /*RGB*/
+    ihdr[10] = 0;   /*Deflate*/
+    ihdr[11] = 0;   /*Adaptive filtering*/
+    ihdr[12] = 0;   /*No interlace*/
+
+    bool ok = fwrite(signature, sizeof(signature), 1, f) == 1 && png_chunk(f, "IHDR", ihdr, sizeof(ihdr));
+
+    /*Every row goes to its own IDAT chunk, together they are one zlib stream*/
+    uint32_t adler_a = 1, adler_b = 0;
+    int32_t x, y;
+    for(y = 0; y < m->ver_res && ok; y++) {
+        bool last_row = y == m->ver_res - 1;
+        uint32_t len = 0;
+        uint32_t i, n;
+
+        if(y == 0) {
+            idat[len++] = 0x78;     /*zlib header: deflate, 32 kB window*/
+            idat[len++] = 0x01;
+        }
+
+        row[0] = 0;     /*No filter*/
+        for(x = 0; x < m->hor_res; x++) {
+            fb_px_to_rgb(fb, &row[1 + x * 3]);
+            fb += SDL_FB_PX_SIZE;
+        }
+
+        for(i = 0; i < row_len; i++) {
+            adler_a = (adler_a + row[i]) % 65521;
+            adler_b = (adler_b + adler_a) % 65521;
+        }
+
+        for(i = 0; i < row_len; i += n) {
+            n = LV_MIN(row_len - i, 0xffff);
+            idat[len++] = (last_row && i + n == row_len) ? 1 : 0;     /*The final block of the stream*/
+            idat[len++] = n & 0xff;
+            idat[len++] = n >> 8;
+            idat[len++] = ~n & 0xff;
+            idat[len++] = (~n >> 8) & 0xff;
+            memcpy(&idat[len], &row[i], n);
+            len += n;
+        }
+
+        if(last_row) {
+            png_put32(&idat[len], (adler_b << 16) | adler_a);
+            len += 4;
+        }
+
+        ok = png_chunk(f, "IDAT", idat, len);
+    }
+
+    if(ok) ok = png_chunk(f, "IEND", NULL, 0);
+
+    if(fclose(f) != 0) ok = false;
+    if(!ok) LV_LOG_ERROR("can't write %s", path);
+
+    free(row);
+    free(idat);
+
+    return ok;
+}
+
+/**
+ * Get the milliseconds elapsed from the selected tick source.
+ * SDL starts counting on the first read, so it can be used as `LV_TICK_CUSTOM_SYS_TIME_EXPR`
+ * even though `lv_init()` reads the tick before `sdl_init()`.
+ * @return the elapsed milliseconds
+ */
+uint32_t sdl_tick_get(void)
+{
+#if SDL_TICK_SOURCE == SDL_TICK_VIRTUAL
+    return virtual_tick;
+#else
+    return SDL_GetTicks();
+#endif
+}
+
+/**
+ * Advance the virtual clock. Only has effect with `SDL_TICK_SOURCE == SDL_TICK_VIRTUAL`.
+ * @param ms milliseconds to add
+ */
+void sdl_tick_advance(uint32_t ms)
+{
+#if SDL_TICK_SOURCE == SDL_TICK_VIRTUAL
+    virtual_tick += ms;
+#if LV_TICK_CUSTOM == 0
+    lv_tick_inc(ms);
+#endif
+#else
+    (void)ms;
+#endif
+}
+
+/**
+ * Start recording the mouse, mouse wheel and keyboard input of all windows to a file
+ * @param path path of the file to write
+ * @return true on success
+ */
+bool sdl_record_start(const char * path)
+{
+    sdl_record_stop();
+
+    record_file = fopen(path, "wb");
+    if(record_file == NULL) {
+        LV_LOG_ERROR("can't open %s", path);
+        return false;
+    }
+
+    uint8_t header[8] = SDL_REC_MAGIC;
+    header[4] = SDL_REC_VERSION;
+    fwrite(header, sizeof(header), 1, record_file);
+    record_start = sdl_tick_get();
+
+    return true;
+}
+
+/**
+ * Stop recording and close the file
+ */
+void sdl_record_stop(void)
+{
+    if(record_file == NULL) return;
+
+    fclose(record_file);
+    record_file = NULL;
+}
+
+/**
+ * Replay the input saved by `sdl_record_start()` with the original timing.
+ * The time is measured with `sdl_tick_get()`, so with `SDL_TICK_VIRTUAL` the replay runs
+ * as fast as the application advances the clock.
+ * @param path path of the recording
+ * @return true on success
+ */
+bool sdl_replay_start(const char * path)
+{
+    sdl_replay_stop();
+
+    replay_file = fopen(path, "rb");
+    if(replay_file == NULL) {
+        LV_LOG_ERROR("can't open %s", path);
+        return false;
+    }
+
+    uint8_t header[8];
+    if(fread(header, sizeof(header), 1, replay_file) != 1 ||
+       memcmp(header, SDL_REC_MAGIC, 4) != 0 || header[4] != SDL_REC_VERSION) {
+        LV_LOG_ERROR("%s is not an input recording", path);
+        sdl_replay_stop();
+        return false;
+    }
+
+    replay_start = sdl_tick_get();
+    if(!rec_event_read(replay_file, &replay_next)) sdl_replay_stop();
+
+    return true;
+}
+
+/**
+ * Stop replaying and close the file
+ */
+void sdl_replay_stop(void)
+{
+    if(replay_file == NULL) return;
+
+    fclose(replay_file);
+    replay_file = NULL;
+    replay_held = false;
+}
+
+/**
+ * Tell whether a replay is in progress
+ * @return true until all the recorded events are replayed
+ */
+bool sdl_replay_is_running(void)
+{
+    return replay_file != NULL;
+}
+
+#if SDL_FRAME_STATS
+/**
+ * Get the statistics of the last frames of a display
+ * @param disp pointer to an SDL display or NULL to use the default display
+ * @param stats store the statistics here
+ * @return false if no frame was shown yet
+ */
+bool sdl_frame_stats_get(lv_disp_t * disp, sdl_frame_stats_t * stats)
+{
+    monitor_t * m = disp_to_monitor(disp);
+    if(m == NULL || m->frame_cnt == 0) return false;
+
+    frame_stats_calc(m, stats);
+    return true;
+}
+
+/**
+ * Write the stage times of every frame of a display to a CSV file
+ * @param disp pointer to an SDL display or NULL to use the default display
+ * @param path path of the file to write or NULL to stop writing
+ * @return true on success
+ */
+bool sdl_frame_stats_csv(lv_disp_t * disp, const char * path)
+{
+    monitor_t * m = disp_to_monitor(disp);
+    if(m == NULL) return false;
+
+    if(m->csv) {
+        fclose(m->csv);
+        m->csv = NULL;
+    }
+    if(path == NULL) return true;
+
+    m->csv = fopen(path, "w");
+    if(m->csv == NULL) {
+        LV_LOG_ERROR("can't open %s", path);
+        return false;
+    }
+
+    fprintf(m->csv, "frame,render_us,flush_us,upload_us,copy_us,present_us\n");
+    return true;
+}
+#endif
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+
+/**
+ * SDL main thread. All SDL related task have to be handled here!
+ * It initializes SDL, handles drawing and the mouse.
+ */
+
+static void sdl_event_handler(lv_timer_t * t)
+{
+    (void)t;
+
+    /*Refresh handling*/
+    SDL_Event event;
+    while(SDL_PollEvent(&event)) {
+        sdl_process_event(&event);
+    }
+
+    replay_process();
+
+    /*Run until quit event not arrives*/
+    if(sdl_quit_qry) {
+        monitor_sdl_clean_up();
+        exit(0);
+    }
+}
+
+/**
+ * Pass an SDL event to the window it belongs to
+ * @param event the event
+ */
+static void sdl_process_event(SDL_Event * event)
+{
+    monitor_t * m = event_to_window(event);
+    if(m == NULL) return;
+
+    /*SDL also reports a touch as mouse events. Ignore them if the fingers are read anyway,
+     *else a touch would click on both input devices.*/
+    switch(event->type) {
+        case SDL_MOUSEBUTTONDOWN:
+        case SDL_MOUSEBUTTONUP:
+            if(event->button.which == SDL_TOUCH_MOUSEID && touch_indev_exists()) return;
+            break;
+        case SDL_MOUSEMOTION:
+            if(event->motion.which == SDL_TOUCH_MOUSEID && touch_indev_exists()) return;
+            break;
+        default:
+            break;
+    }
+
+    mouse_handler(m, event);
+    mousewheel_handler(m, event);
+    keyboard_handler(m, event);
+    touch_handler(m, event);
+
+    if(record_file) {
+        switch(event->type) {
+            case SDL_MOUSEMOTION:
+                record_event(m, SDL_REC_MOUSE, m->left_button_down, (uint16_t)m->last_x | ((uint32_t)(uint16_t)m->last_y << 16));
+                break;
+            case SDL_MOUSEBUTTONDOWN:
+            case SDL_MOUSEBUTTONUP:
+                if(event->button.button == SDL_BUTTON_LEFT) {
+                    record_event(m, SDL_REC_MOUSE, m->left_button_down, (uint16_t)m->last_x | ((uint32_t)(uint16_t)m->last_y << 16));
+                }
+                else if(event->button.button == SDL_BUTTON_MIDDLE) {
+                    record_event(m, SDL_REC_WHEEL_BTN, m->wheel_state == LV_INDEV_STATE_PRESSED, 0);
+                }
+                break;
+            case SDL_MOUSEWHEEL:
+                record_event(m, SDL_REC_WHEEL, false, (uint32_t)m->wheel_diff);
+                break;
+            default:
+                break;
+        }
+    }
+
+    if(event->type == SDL_WINDOWEVENT) {
+        switch(event->window.event) {
+#if SDL_VERSION_ATLEAST(2, 0, 5)
+            case SDL_WINDOWEVENT_TAKE_FOCUS:
+#endif
+            case SDL_WINDOWEVENT_EXPOSED:
+                window_update(m);
+                break;
+            case SDL_WINDOWEVENT_SIZE_CHANGED:
+                window_update_scale_mode(m);
+                window_update(m);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+/**
+ * Make the read timers of the SDL input devices ready
+ */
+static void indev_read_ready(void)
+{
+    lv_indev_t * indev = lv_indev_get_next(NULL);
+    while(indev) {
+        lv_indev_drv_t * drv = indev->driver;
+        if(drv->read_cb == sdl_mouse_read || drv->read_cb == sdl_mousewheel_read ||
+           drv->read_cb == sdl_keyboard_read || drv->read_cb == sdl_touch_read) {
+            if(drv->read_timer) lv_timer_ready(drv->read_timer);
+        }
+        indev = lv_indev_get_next(indev);
+    }
+}
+
+/**
+ * Tell if a touch input device is registered
+ * @return true if an input device reads `sdl_touch_read()`
+ */
+static bool touch_indev_exists(void)
+{
+    lv_indev_t * indev = lv_indev_get_next(NULL);
+    while(indev) {
+        if(indev->driver->read_cb == sdl_touch_read) return true;
+        indev = lv_indev_get_next(indev);
+    }
+
+    return false;
+}
+
+int quit_filter(void * userdata, SDL_Event * event)
+{
+    (void)userdata;
+
+    if(event->type == SDL_WINDOWEVENT) {
+        if(event->window.event == SDL_WINDOWEVENT_CLOSE) {
+            sdl_quit_qry = true;
+        }
+    }
+    else if(event->type == SDL_QUIT) {
+        sdl_quit_qry = true;
+    }
+
+    return 1;
+}
+
+static void monitor_sdl_clean_up(void)
+{
+    while(monitor_list) {
+        monitor_t * m = monitor_list;
+        monitor_list = m->next;
+
+#if SDL_HEADLESS == 0
+        SDL_DestroyTexture(m->texture);
+        SDL_DestroyRenderer(m->renderer);
+        SDL_DestroyWindow(m->window);
+#endif
+        free(m->tft_fb);
+#if SDL_FRAME_STATS
+        if(m->csv) fclose(m->csv);
+#endif
+        free(m);
+    }
+
+    SDL_Quit();
+}
+
+/**
+ * Create a window and its frame buffer
+ * @param disp_drv the display driver shown in the window
+ * @param hor_res horizontal resolution
+ * @param ver_res vertical resolution
+ * @param zoom initial scale of the window
+ * @return the new window or NULL on error
+ */
+static monitor_t * window_create(lv_disp_drv_t * disp_drv, lv_coord_t hor_res, lv_coord_t ver_res, float zoom)
+{
+    monitor_t * m = calloc(1, sizeof(monitor_t));
+    if(m == NULL) return NULL;
+
+    m->disp_drv = disp_drv;
+    m->index = monitor_cnt++;
+    m->hor_res = hor_res;
+    m->ver_res = ver_res;
+    m->zoom = zoom > 0 ? zoom : 1;
+    m->wheel_state = LV_INDEV_STATE_RELEASED;
+    m->key_state = LV_INDEV_STATE_RELEASED;
+
+#if SDL_HEADLESS
+    /*Only the frame buffer is needed*/
+    m->window = NULL;
+    m->renderer = NULL;
+    m->texture = NULL;
+#else
+    /*Place new windows next to the last one*/
+    int x = SDL_WINDOWPOS_UNDEFINED, y = SDL_WINDOWPOS_UNDEFINED;
+    if(monitor_list) {
+        int w;
+        SDL_GetWindowPosition(monitor_list->window, &x, &y);
+        SDL_GetWindowSize(monitor_list->window, &w, NULL);
+        x += w + 10;
+    }
+
+    /*The renderer scales the texture to the window, so resizing and HiDPI don't cost extra rendering*/
+    m->window = SDL_CreateWindow("TFT Simulator", x, y,
+                              (int)(hor_res * m->zoom + 0.5f), (int)(ver_res * m->zoom + 0.5f),
+                              SDL_WINDOW_RESIZABLE | SDL_WINDOW_ALLOW_HIGHDPI);       /*SDL_WINDOW_BORDERLESS to hide borders*/
+    if(m->window == NULL) {
+        LV_LOG_ERROR("can't create window: %s", SDL_GetError());
+        free(m);
+        return NULL;
+    }
+    m->window_id = SDL_GetWindowID(m->window);
+
+    m->renderer = NULL;
+#if SDL_ACCELERATED
+    m->renderer = SDL_CreateRenderer(m->window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+#endif
+    /*Software rendering works everywhere, also with the offscreen/dummy video drivers*/
+    if(m->renderer == NULL) {
+        m->renderer = SDL_CreateRenderer(m->window, -1, SDL_RENDERER_SOFTWARE);
+    }
+
+    SDL_RendererInfo info;
+    if(SDL_GetRendererInfo(m->renderer, &info) == 0) {
+        LV_LOG_USER("SDL renderer: %s%s%s", info.name,
+                    (info.flags & SDL_RENDERER_ACCELERATED) ? ", accelerated" : ", software",
+                    (info.flags & SDL_RENDERER_PRESENTVSYNC) ? ", vsync" : "");
+    }
+
+    /*Map the texture to the window keeping the aspect ratio. SDL converts the mouse coordinates back too.*/
+    SDL_RenderSetLogicalSize(m->renderer, hor_res, ver_res);
+
+    window_update_scale_mode(m);
+    m->texture = SDL_CreateTexture(m->renderer,
+                                SDL_FB_FORMAT, SDL_TEXTUREACCESS_STREAMING, hor_res, ver_res);
+    SDL_SetTextureBlendMode(m->texture, SDL_BLENDMODE_BLEND);
+#endif
+
+    /*Initialize the frame buffer to gray (77 is an empirical value).
+     *With double buffering it's allocated only if the draw buffers can't be shown directly*/
+#if SDL_DOUBLE_BUFFERED
+    m->tft_fb = NULL;
+    m->tft_fb_act = NULL;
+#else
+    m->tft_fb = (uint8_t *)malloc(SDL_FB_PX_SIZE * hor_res * ver_res);
+    if(m->tft_fb) memset(m->tft_fb, 0x44, hor_res * ver_res * SDL_FB_PX_SIZE);
+    m->tft_fb_act = m->tft_fb;
+#endif
+
+    window_set_all_dirty(m);
+
+    m->next = monitor_list;
+    monitor_list = m;
+
+    return m;
+}
+
+/**
+ * Remember an area to upload to the texture on the next update
+ * @param m the window
+ * @param area the flushed area, clipped to the screen here
+ */
+static void window_add_dirty(monitor_t * m, const lv_area_t * area)
+{
+    SDL_Rect r;
+    r.x = LV_MAX(area->x1, 0);
+    r.y = LV_MAX(area->y1, 0);
+    r.w = LV_MIN(area->x2, m->hor_res - 1) - r.x + 1;
+    r.h = LV_MIN(area->y2, m->ver_res - 1) - r.y + 1;
+    if(r.w <= 0 || r.h <= 0) return;
+
+    if(m->dirty_cnt < SDL_DIRTY_AREA_CNT) {
+        m->dirty[m->dirty_cnt] = r;
+        m->dirty_cnt++;
+        return;
+    }
+
+    /*Out of slots: keep only the bounding box of everything*/
+    uint32_t i;
+    int32_t x1 = r.x, y1 = r.y, x2 = r.x + r.w, y2 = r.y + r.h;
+    for(i = 0; i < m->dirty_cnt; i++) {
+        x1 = LV_MIN(x1, m->dirty[i].x);
+        y1 = LV_MIN(y1, m->dirty[i].y);
+        x2 = LV_MAX(x2, m->dirty[i].x + m->dirty[i].w);
+        y2 = LV_MAX(y2, m->dirty[i].y + m->dirty[i].h);
+    }
+    m->dirty[0].x = x1;
+    m->dirty[0].y = y1;
+    m->dirty[0].w = x2 - x1;
+    m->dirty[0].h = y2 - y1;
+    m->dirty_cnt = 1;
+}
+
+static void window_set_all_dirty(monitor_t * m)
+{
+    m->dirty[0].x = 0;
+    m->dirty[0].y = 0;
+    m->dirty[0].w = m->hor_res;
+    m->dirty[0].h = m->ver_res;
+    m->dirty_cnt = 1;
+}
+
+/**
+ * Keep the pixels sharp while the window scales the texture by an integer factor
+ * and filter linearly for fractional factors. Call it when the window size changes.
+ * @param m pointer to the window
+ */
+static void window_update_scale_mode(monitor_t * m)
+{
+#if SDL_HEADLESS
+    (void)m;
+#else
+    int w, h;
+    if(SDL_GetRendererOutputSize(m->renderer, &w, &h) != 0) return;
+
+    /*The logical size keeps the aspect ratio, so the smaller factor is applied*/
+    float scale = LV_MIN((float)w / m->hor_res, (float)h / m->ver_res);
+    bool sharp = scale == (int)scale;
+    if(m->texture && sharp == m->scale_sharp) return;
+    m->scale_sharp = sharp;
+
+#if SDL_VERSION_ATLEAST(2, 0, 12)
+    if(m->texture) {
+        SDL_SetTextureScaleMode(m->texture, sharp ? SDL_ScaleModeNearest : SDL_ScaleModeLinear);
+        return;
+    }
+#endif
+
+    /*Older SDL versions read the hint only when a texture is created*/
+    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, sharp ? "nearest" : "linear");
+    if(m->texture) {
+        SDL_DestroyTexture(m->texture);
+        m->texture = SDL_CreateTexture(m->renderer,
+                                    SDL_FB_FORMAT, SDL_TEXTUREACCESS_STREAMING, m->hor_res, m->ver_res);
+        SDL_SetTextureBlendMode(m->texture, SDL_BLENDMODE_BLEND);
+        window_set_all_dirty(m);
+    }
+#endif
+}
+
+static void window_update(monitor_t * m)
+{
+#if SDL_HEADLESS
+    /*Nothing to present, the frame buffer is read directly*/
+    m->dirty_cnt = 0;
+#else
+    const uint8_t * fb = window_get_fb(m);
+    if(fb == NULL) return;
+
+#if SDL_FRAME_STATS
+    uint64_t t = SDL_GetPerformanceCounter();
+#endif
+
+    /*Upload only the areas flushed since the last present*/
+    uint32_t i;
+    for(i = 0; i < m->dirty_cnt; i++) {
+        const SDL_Rect * r = &m->dirty[i];
+        uint8_t * pixels;
+        int pitch;
+        if(SDL_LockTexture(m->texture, r, (void **)&pixels, &pitch) != 0) continue;
+
+        const uint8_t * src = fb + (r->y * m->hor_res + r->x) * SDL_FB_PX_SIZE;
+        int32_t y;
+        for(y = 0; y < r->h; y++) {
+            memcpy(pixels, src, r->w * SDL_FB_PX_SIZE);
+            pixels += pitch;
+            src += m->hor_res * SDL_FB_PX_SIZE;
+        }
+        SDL_UnlockTexture(m->texture);
+    }
+    m->dirty_cnt = 0;
+
+#if SDL_FRAME_STATS
+    m->cur.upload = perf_us(t);
+    t = SDL_GetPerformanceCounter();
+#endif
+
+    SDL_RenderClear(m->renderer);
+#if LV_COLOR_SCREEN_TRANSP
+    SDL_SetRenderDrawColor(m->renderer, 0xff, 0, 0, 0xff);
+    SDL_Rect r;
+    r.x = 0; r.y = 0; r.w = m->hor_res; r.h = m->ver_res;
+    SDL_RenderDrawRect(m->renderer, &r);
+#endif
+
+    /*Update the renderer with the texture containing the rendered image*/
+    SDL_RenderCopy(m->renderer, m->texture, NULL, NULL);
+#if SDL_FRAME_STATS
+    m->cur.copy = perf_us(t);
+    t = SDL_GetPerformanceCounter();
+#endif
+    SDL_RenderPresent(m->renderer);
+#if SDL_FRAME_STATS
+    m->cur.present = perf_us(t);
+#endif
+#endif
+}
+
+static const uint8_t * window_get_fb(const monitor_t * m)
+{
+    return m->tft_fb_act;
+}
+
+/**
+ * Copy a flushed area to the window's own frame buffer
+ * @param m the window
+ * @param disp_drv the display driver
+ * @param area the flushed area
+ * @param color_p the rendered pixels: the area only or the whole screen in direct mode
+ * @return false if the frame buffer couldn't be allocated
+ */
+static bool window_copy_area(monitor_t * m, const lv_disp_drv_t * disp_drv, const lv_area_t * area, const lv_color_t * color_p)
+{
+    if(m->tft_fb == NULL) {
+        m->tft_fb = malloc(SDL_FB_PX_SIZE * m->hor_res * m->ver_res);
+        if(m->tft_fb == NULL) {
+            LV_LOG_ERROR("can't allocate the frame buffer");
+            return false;
+        }
+#if SDL_DOUBLE_BUFFERED
+        LV_LOG_WARN("SDL_DOUBLE_BUFFERED needs direct_mode or full_refresh to avoid copying");
+#endif
+    }
+
+    /*Only the part on the screen*/
+    int32_t x1 = LV_MAX(area->x1, 0);
+    int32_t y1 = LV_MAX(area->y1, 0);
+    int32_t x2 = LV_MIN(area->x2, m->hor_res - 1);
+    int32_t y2 = LV_MIN(area->y2, m->ver_res - 1);
+
+    /*In direct mode `color_p` is the whole screen, else only the area*/
+    int32_t stride = disp_drv->direct_mode ? disp_drv->hor_res : lv_area_get_width(area);
+    const lv_color_t * src = disp_drv->direct_mode ? color_p + y1 * stride + x1 :
+                             color_p + (y1 - area->y1) * stride + (x1 - area->x1);
+
+    int32_t y;
+    for(y = y1; y <= y2; y++) {
+        copy_row(&m->tft_fb[(y * m->hor_res + x1) * SDL_FB_PX_SIZE], src, x2 - x1 + 1);
+        src += stride;
+    }
+
+    return true;
+}
+
+#if SDL_DOUBLE_BUFFERED
+/**
+ * Copy the areas rendered in this frame to the other draw buffer.
+ * In direct mode LVGL redraws only the invalidated areas, so the next buffer needs them too.
+ * @param m the window
+ * @param disp_drv the display driver
+ */
+static void window_sync_buffers(monitor_t * m, lv_disp_drv_t * disp_drv)
+{
+    /*Full refresh redraws everything anyway*/
+    if(!disp_drv->direct_mode) return;
+    if(m->tft_fb_act == m->tft_fb) return;
+
+    lv_disp_draw_buf_t * draw_buf = disp_drv->draw_buf;
+    if(draw_buf->buf1 == NULL || draw_buf->buf2 == NULL) return;
+
+    const uint8_t * src = m->tft_fb_act;
+    uint8_t * dst = src == (uint8_t *)draw_buf->buf1 ? draw_buf->buf2 : draw_buf->buf1;
+    uint32_t stride = disp_drv->hor_res * sizeof(lv_color_t);
+
+    uint32_t i;
+    for(i = 0; i < m->dirty_cnt; i++) {
+        const SDL_Rect * r = &m->dirty[i];
+        uint32_t offs = r->y * stride + r->x * sizeof(lv_color_t);
+        int32_t y;
+        for(y = 0; y < r->h; y++) {
+            memcpy(dst + offs, src + offs, r->w * sizeof(lv_color_t));
+            offs += stride;
+        }
+    }
+}
+#endif
+
+/**
+ * Find a window by its SDL window ID
+ * @param id the SDL window ID
+ * @return the window or NULL if not found
+ */
+static monitor_t * window_from_id(uint32_t id)
+{
+    monitor_t * m;
+    for(m = monitor_list; m; m = m->next) {
+        if(m->window_id == id) return m;
+    }
+
+    /*Events without a window (e.g. pushed by the application) go to the only window*/
+    if(monitor_list && monitor_list->next == NULL) return monitor_list;
+
+    return NULL;
+}
+
+/**
+ * Find the window an input or window event belongs to
+ * @param event the event
+ * @return the window or NULL if the event doesn't belong to any window
+ */
+static monitor_t * event_to_window(const SDL_Event * event)
+{
+    switch(event->type) {
+        case SDL_MOUSEBUTTONDOWN:
+        case SDL_MOUSEBUTTONUP:
+            return window_from_id(event->button.windowID);
+        case SDL_MOUSEMOTION:
+            return window_from_id(event->motion.windowID);
+        case SDL_MOUSEWHEEL:
+            return window_from_id(event->wheel.windowID);
+        case SDL_KEYDOWN:
+        case SDL_KEYUP:
+            return window_from_id(event->key.windowID);
+        case SDL_TEXTINPUT:
+            return window_from_id(event->text.windowID);
+        case SDL_WINDOWEVENT:
+            return window_from_id(event->window.windowID);
+        case SDL_FINGERDOWN:
+        case SDL_FINGERUP:
+        case SDL_FINGERMOTION:
+#if SDL_VERSION_ATLEAST(2, 0, 22)
+            return window_from_id(event->tfinger.windowID);
+#endif
+        case SDL_MULTIGESTURE:
+            /*Older SDL versions and gestures don't tell the window of touch events*/
+#if SDL_HEADLESS == 0
+            return window_from_id(SDL_GetWindowID(SDL_GetMouseFocus()));
+#else
+            return window_from_id(0);
+#endif
+        default:
+            return NULL;
+    }
+}
+
+/**
+ * Find the window of a display driver. The driver's `user_data` is left to the application.
+ * @param disp_drv pointer to a display driver
+ * @return the window or NULL if no window shows this driver yet
+ */
+static monitor_t * drv_to_monitor(const lv_disp_drv_t * disp_drv)
+{
+    monitor_t * m;
+    for(m = monitor_list; m; m = m->next) {
+        if(m->disp_drv == disp_drv) return m;
+    }
+
+    return NULL;
+}
+
+/**
+ * Find the window of a display
+ * @param disp pointer to a display or NULL to use the default display
+ * @return the window or NULL if the display isn't an SDL display
+ */
+static monitor_t * disp_to_monitor(lv_disp_t * disp)
+{
+    if(disp == NULL) disp = lv_disp_get_default();
+    if(disp == NULL) return NULL;
+
+    return drv_to_monitor(disp->driver);
+}
+
+/**
+ * Find the window an input device reads
+ * @param indev_drv pointer to the input device driver
+ * @return the window of the input device's display or NULL if it has no window yet
+ */
+static monitor_t * indev_to_monitor(lv_indev_drv_t * indev_drv)
+{
+    return disp_to_monitor(indev_drv->disp);
+}
+
+/**
+ * Convert a frame buffer pixel to 8 bit R, G, B values
+ * @param px pointer to the pixel
+ * @param rgb store the 3 components here
+ */
+static void fb_px_to_rgb(const uint8_t * px, uint8_t * rgb)
+{
+#if SDL_FB_PX_SIZE == 4
+    uint32_t c;
+    memcpy(&c, px, sizeof(c));
+    rgb[0] = (c >> 16) & 0xff;
+    rgb[1] = (c >> 8) & 0xff;
+    rgb[2] = c & 0xff;
+#elif SDL_FB_PX_SIZE == 2
+    uint16_t c;
+    memcpy(&c, px, sizeof(c));
+    rgb[0] = ((c >> 11) & 0x1f) * 255 / 31;
+    rgb[1] = ((c >> 5) & 0x3f) * 255 / 63;
+    rgb[2] = (c & 0x1f) * 255 / 31;
+#else
+    uint8_t c = *px;
+    rgb[0] = ((c >> 5) & 0x07) * 255 / 7;
+    rgb[1] = ((c >> 2) & 0x07) * 255 / 7;
+    rgb[2] = (c & 0x03) * 255 / 3;
+#endif
+}
+
+/**
+ * Update a CRC-32 as used by PNG chunks
+ * @param crc the CRC so far, 0 to start
+ * @param buf the data to add
+ * @param len length of the data
+ * @return the new CRC
+ */
+static uint32_t png_crc(uint32_t crc, const uint8_t * buf, uint32_t len)
+{
+    uint32_t i;
+    int k;
+
+    crc = ~crc;
+    for(i = 0; i < len; i++) {
+        crc ^= buf[i];
+        for(k = 0; k < 8; k++) {
+            crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+        }
+    }
+
+    return ~crc;
+}
+
+/**
+ * Store a 32 bit value in the big endian byte order of PNG
+ * @param p where to store
+ * @param v the value
+ */
+static void png_put32(uint8_t * p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+/**
+ * Write a PNG chunk
+ * @param f the file
+ * @param type the 4 character chunk type
+ * @param data the chunk data, can be NULL if `len` is 0
+ * @param len length of the data
+ * @return true on success
+ */
+static bool png_chunk(FILE * f, const char * type, const uint8_t * data, uint32_t len)
+{
+    uint8_t head[8];
+    uint8_t crc[4];
+
+    png_put32(&head[0], len);
+    memcpy(&head[4], type, 4);
+    png_put32(crc, png_crc(png_crc(0, &head[4], 4), data, len));
+
+    return fwrite(head, sizeof(head), 1, f) == 1 &&
+           (len == 0 || fwrite(data, len, 1, f) == 1) &&
+           fwrite(crc, sizeof(crc), 1, f) == 1;
+}
+
+/**
+ * Copy a row of LVGL colors to the frame buffer in the texture's format
+ * @param dst destination in the frame buffer
+ * @param src the colors
+ * @param w number of pixels
+ */
+static void copy_row(uint8_t * dst, const lv_color_t * src, uint32_t w)
+{
+#if LV_COLOR_DEPTH == 16 && LV_COLOR_16_SWAP
+    /*Swap the bytes back to plain RGB565*/
+    const uint16_t * s = (const uint16_t *)src;
+    uint16_t * d = (uint16_t *)dst;
+    uint32_t i = 0;
+#if defined(__SSE2__)
+    for(; i + 8 <= w; i += 8) {
+        __m128i px = _mm_loadu_si128((const __m128i *)(s + i));
+        _mm_storeu_si128((__m128i *)(d + i), _mm_or_si128(_mm_slli_epi16(px, 8), _mm_srli_epi16(px, 8)));
+    }
+#elif defined(__ARM_NEON)
+    for(; i + 8 <= w; i += 8) {
+        vst1q_u8((uint8_t *)(d + i), vrev16q_u8(vld1q_u8((const uint8_t *)(s + i))));
+    }
+#endif
+    for(; i < w; i++) {
+        d[i] = (uint16_t)((s[i] << 8) | (s[i] >> 8));
+    }
+#elif LV_COLOR_DEPTH == 1
+    uint32_t * d = (uint32_t *)dst;
+    uint32_t i;
+    for(i = 0; i < w; i++) {
+        d[i] = lv_color_to32(src[i]);
+    }
+#else
+    memcpy(dst, src, w * sizeof(lv_color_t));
+#endif
+}
+
+static void mouse_handler(monitor_t * m, SDL_Event * event)
+{
+    switch(event->type) {
+        case SDL_MOUSEBUTTONUP:
             if(event->button.button == SDL_BUTTON_LEFT)
-                left_button_down = false;
+                m->left_button_down = false;
             break;
         case SDL_MOUSEBUTTONDOWN:
             if(event->button.button == SDL_BUTTON_LEFT) {
-                left_button_down = true;
-                last_x = event->motion.x / SDL_ZOOM;
-                last_y = event->motion.y / SDL_ZOOM;
+                m->left_button_down = true;
+                m->last_x = LV_MAX(LV_MIN(event->button.x, m->hor_res - 1), 0);
+                m->last_y = LV_MAX(LV_MIN(event->button.y, m->ver_res - 1), 0);
             }
             break;
         case SDL_MOUSEMOTION:
-            last_x = event->motion.x / SDL_ZOOM;
-            last_y = event->motion.y / SDL_ZOOM;
+            /*Already in display coordinates thanks to SDL_RenderSetLogicalSize(), only clip the borders*/
+            m->last_x = LV_MAX(LV_MIN(event->motion.x, m->hor_res - 1), 0);
+            m->last_y = LV_MAX(LV_MIN(event->motion.y, m->ver_res - 1), 0);
             break;
 
-        case SDL_FINGERUP:
-            left_button_down = false;
-            last_x = LV_HOR_RES * event->tfinger.x / SDL_ZOOM;
-            last_y = LV_VER_RES * event->tfinger.y / SDL_ZOOM;
-            break;
-        case SDL_FINGERDOWN:
-            left_button_down = true;
-            last_x = LV_HOR_RES * event->tfinger.x / SDL_ZOOM;
-            last_y = LV_VER_RES * event->tfinger.y / SDL_ZOOM;
-            break;
-        case SDL_FINGERMOTION:
-            last_x = LV_HOR_RES * event->tfinger.x / SDL_ZOOM;
-            last_y = LV_VER_RES * event->tfinger.y / SDL_ZOOM;
-            break;
+        /*A touch also arrives as synthesized mouse events, they are dropped in `sdl_process_event()`
+         *if the touch input device is used*/
     }
 
 }
@@ -507,7 +1724,7 @@ static void mouse_handler(SDL_Event * event)
  * It is called periodically from the SDL thread to check mouse wheel state
  * @param event describes the event
  */
-static void mousewheel_handler(SDL_Event * event)
+static void mousewheel_handler(monitor_t * m, SDL_Event * event)
 {
     switch(event->type) {
         case SDL_MOUSEWHEEL:
@@ -515,20 +1732,20 @@ static void mousewheel_handler(SDL_Event * event)
             // so invert it
 #ifdef __EMSCRIPTEN__
             /*Escripten scales it wrong*/
-            if(event->wheel.y < 0) wheel_diff++;
-            if(event->wheel.y > 0) wheel_diff--;
+            if(event->wheel.y < 0) m->wheel_diff++;
+            if(event->wheel.y > 0) m->wheel_diff--;
 #else
-            wheel_diff = -event->wheel.y;
+            m->wheel_diff = -event->wheel.y;
 #endif
             break;
         case SDL_MOUSEBUTTONDOWN:
             if(event->button.button == SDL_BUTTON_MIDDLE) {
-                wheel_state = LV_INDEV_STATE_PRESSED;
+                m->wheel_state = LV_INDEV_STATE_PRESSED;
             }
             break;
         case SDL_MOUSEBUTTONUP:
             if(event->button.button == SDL_BUTTON_MIDDLE) {
-                wheel_state = LV_INDEV_STATE_RELEASED;
+                m->wheel_state = LV_INDEV_STATE_RELEASED;
             }
             break;
         default:
@@ -541,33 +1758,468 @@ static void mousewheel_handler(SDL_Event * event)
  * Called periodically from the SDL thread, store text input or control characters in the buffer.
  * @param event describes the event
  */
-static void keyboard_handler(SDL_Event * event)
+static void keyboard_handler(monitor_t * m, SDL_Event * event)
 {
-    /* We only care about SDL_KEYDOWN and SDL_TEXTINPUT events */
+    /* We only care about SDL_KEYDOWN, SDL_KEYUP and SDL_TEXTINPUT events */
     switch(event->type) {
         case SDL_KEYDOWN:                       /*Button press*/
+        case SDL_KEYUP:                         /*Button release*/
             {
+                /*LVGL repeats the held keys itself*/
+                if(event->key.repeat) return;
                 const uint32_t ctrl_key = keycode_to_ctrl_key(event->key.keysym.sym);
                 if (ctrl_key == '\0')
                     return;
-                const size_t len = strlen(buf);
-                if (len < KEYBOARD_BUFFER_SIZE - 1) {
-                    buf[len] = ctrl_key;
-                    buf[len + 1] = '\0';
-                }
+                key_push(m, ctrl_key | (event->type == SDL_KEYDOWN ? SDL_KEY_PRESSED : 0));
                 break;
             }
         case SDL_TEXTINPUT:                     /*Text input*/
             {
-                const size_t len = strlen(buf) + strlen(event->text.text);
-                if (len < KEYBOARD_BUFFER_SIZE - 1)
-                    strcat(buf, event->text.text);
+                /*There is no release event for text, send a press and a release for every character*/
+                const char * txt = event->text.text;
+                while(*txt) {
+                    uint32_t cp = utf8_decode(&txt);
+                    if(cp == 0) continue;
+                    key_push(m, cp | SDL_KEY_PRESSED);
+                    key_push(m, cp);
+                }
+            }
+            break;
+        default:
+            break;
+
+    }
+}
+
+/**
+ * Track the fingers and the multi-finger gestures in the slot table of a window
+ * @param m the window
+ * @param event describes the event
+ */
+static void touch_handler(monitor_t * m, SDL_Event * event)
+{
+    touch_slot_t * slot;
+
+    switch(event->type) {
+        case SDL_FINGERDOWN:
+            slot = touch_find(m, event->tfinger.fingerId);
+            if(slot == NULL) slot = touch_alloc(m);
+            if(slot == NULL) break;     /*No free slot, ignore this finger*/
+            slot->id = event->tfinger.fingerId;
+            slot->active = true;
+            /*Fall through*/
+        case SDL_FINGERMOTION:
+        case SDL_FINGERUP:
+            slot = touch_find(m, event->tfinger.fingerId);
+            if(slot == NULL) break;
+
+            /*The coordinates are normalized to the window (to the logical size with newer SDL) so the zoom doesn't matter*/
+            slot->point.x = LV_MAX(LV_MIN((lv_coord_t)(event->tfinger.x * m->hor_res), m->hor_res - 1), 0);
+            slot->point.y = LV_MAX(LV_MIN((lv_coord_t)(event->tfinger.y * m->ver_res), m->ver_res - 1), 0);
+
+            if(event->type == SDL_FINGERUP) {
+                /*Report the release where the primary finger was lifted*/
+                if(slot == touch_primary(m)) m->touch_last = slot->point;
+                slot->active = false;
             }
             break;
+
+        case SDL_MULTIGESTURE:
+            /*Accumulate until read*/
+            m->gesture.pinch += event->mgesture.dDist;
+            m->gesture.rotation += event->mgesture.dTheta;
+            m->gesture.center.x = (lv_coord_t)(event->mgesture.x * m->hor_res);
+            m->gesture.center.y = (lv_coord_t)(event->mgesture.y * m->ver_res);
+            m->gesture.finger_cnt = event->mgesture.numFingers;
+            break;
+
         default:
             break;
+    }
+}
+
+/**
+ * Find the slot of a finger
+ * @param m the window
+ * @param id ID of the finger
+ * @return the slot or NULL if the finger isn't tracked
+ */
+static touch_slot_t * touch_find(monitor_t * m, SDL_FingerID id)
+{
+    uint32_t i;
+    for(i = 0; i < SDL_TOUCH_MAX; i++) {
+        if(m->touch[i].active && m->touch[i].id == id) return &m->touch[i];
+    }
+
+    return NULL;
+}
+
+static touch_slot_t * touch_alloc(monitor_t * m)
+{
+    uint32_t i;
+    for(i = 0; i < SDL_TOUCH_MAX; i++) {
+        if(!m->touch[i].active) return &m->touch[i];
+    }
+
+    return NULL;
+}
+
+/**
+ * Get the finger reported by `sdl_touch_read()`
+ * @param m the window
+ * @return the active slot with the lowest index or NULL if nothing touches the window
+ */
+static touch_slot_t * touch_primary(monitor_t * m)
+{
+    uint32_t i;
+    for(i = 0; i < SDL_TOUCH_MAX; i++) {
+        if(m->touch[i].active) return &m->touch[i];
+    }
+
+    return NULL;
+}
+
+#if SDL_FRAME_STATS
+/**
+ * Get the microseconds elapsed since a performance counter value
+ * @param start an earlier value of `SDL_GetPerformanceCounter()`
+ * @return the elapsed microseconds
+ */
+static uint32_t perf_us(uint64_t start)
+{
+    return (uint32_t)((SDL_GetPerformanceCounter() - start) * 1000000 / SDL_GetPerformanceFrequency());
+}
+
+/**
+ * Save the times of the frame just presented and show the statistics in the title once a second
+ * @param m the window
+ */
+static void frame_stats_add(monitor_t * m)
+{
+    uint32_t idx = m->frame_cnt % SDL_FRAME_STATS_CNT;
+    m->frames[idx] = m->cur;
+    m->frame_end[idx] = SDL_GetPerformanceCounter();
+    m->frame_cnt++;
+
+    if(m->csv) {
+        fprintf(m->csv, "%u,%u,%u,%u,%u,%u\n", (unsigned)m->frame_cnt, (unsigned)m->cur.render,
+                (unsigned)m->cur.flush, (unsigned)m->cur.upload, (unsigned)m->cur.copy, (unsigned)m->cur.present);
+    }
+
+#if SDL_HEADLESS == 0
+    uint32_t now = SDL_GetTicks();
+    if(now - m->title_time < 1000) return;
+    m->title_time = now;
+
+    sdl_frame_stats_t stats;
+    frame_stats_calc(m, &stats);
+
+    char title[160];
+    snprintf(title, sizeof(title),
+             "TFT Simulator | %.1f fps | p50 %.1f p99 %.1f ms | render %.1f flush %.1f upload %.1f copy %.1f present %.1f ms",
+             stats.fps, stats.p50 / 1000.0, stats.p99 / 1000.0,
+             stats.avg.render / 1000.0, stats.avg.flush / 1000.0, stats.avg.upload / 1000.0,
+             stats.avg.copy / 1000.0, stats.avg.present / 1000.0);
+    SDL_SetWindowTitle(m->window, title);
+#endif
+}
+
+/**
+ * Calculate the statistics of the frames kept in a window
+ * @param m the window, at least one frame must be presented
+ * @param stats store the statistics here
+ */
+static void frame_stats_calc(monitor_t * m, sdl_frame_stats_t * stats)
+{
+    uint32_t cnt = LV_MIN(m->frame_cnt, SDL_FRAME_STATS_CNT);
+    uint32_t total[SDL_FRAME_STATS_CNT];
+    uint64_t sum[5] = {0};
+    uint32_t i;
+
+    for(i = 0; i < cnt; i++) {
+        const frame_time_t * f = &m->frames[i];
+        total[i] = f->render + f->flush + f->upload + f->copy + f->present;
+        sum[0] += f->render;
+        sum[1] += f->flush;
+        sum[2] += f->upload;
+        sum[3] += f->copy;
+        sum[4] += f->present;
+    }
+
+    stats->avg.render = sum[0] / cnt;
+    stats->avg.flush = sum[1] / cnt;
+    stats->avg.upload = sum[2] / cnt;
+    stats->avg.copy = sum[3] / cnt;
+    stats->avg.present = sum[4] / cnt;
+
+    qsort(total, cnt, sizeof(total[0]), frame_time_cmp);
+    stats->p50 = total[(cnt - 1) * 50 / 100];
+    stats->p90 = total[(cnt - 1) * 90 / 100];
+    stats->p99 = total[(cnt - 1) * 99 / 100];
+
+    /*Frame rate from the first and last frame kept*/
+    stats->fps = 0;
+    if(cnt > 1) {
+        uint32_t last = (m->frame_cnt - 1) % SDL_FRAME_STATS_CNT;
+        uint32_t first = (m->frame_cnt - cnt) % SDL_FRAME_STATS_CNT;
+        uint64_t span = m->frame_end[last] - m->frame_end[first];
+        if(span) stats->fps = (float)(cnt - 1) * SDL_GetPerformanceFrequency() / span;
+    }
+}
+
+static int frame_time_cmp(const void * a, const void * b)
+{
+    uint32_t ta = *(const uint32_t *)a;
+    uint32_t tb = *(const uint32_t *)b;
+    return ta < tb ? -1 : ta > tb;
+}
+#endif
+
+/**
+ * Queue a key event of a window and record it
+ * @param m the window
+ * @param ev the key event
+ */
+static void key_push(monitor_t * m, uint32_t ev)
+{
+    if(!key_ring_push(&m->keys, ev)) {
+        LV_LOG_WARN("key buffer full");
+        return;
+    }
+
+    record_event(m, SDL_REC_KEY, (ev & SDL_KEY_PRESSED) != 0, ev);
+}
+
+/**
+ * Write an input event to the recording if it's running
+ * @param m the window that received the input
+ * @param type type of the event
+ * @param pressed button state
+ * @param data type specific data
+ */
+static void record_event(monitor_t * m, rec_type_t type, bool pressed, uint32_t data)
+{
+    if(record_file == NULL) return;
+
+    uint32_t time = sdl_tick_get() - record_start;
+    uint8_t rec[SDL_REC_SIZE];
+    rec[0] = time & 0xff;
+    rec[1] = (time >> 8) & 0xff;
+    rec[2] = (time >> 16) & 0xff;
+    rec[3] = (time >> 24) & 0xff;
+    rec[4] = type;
+    rec[5] = m->index;
+    rec[6] = pressed ? 1 : 0;
+    rec[7] = 0;
+    rec[8] = data & 0xff;
+    rec[9] = (data >> 8) & 0xff;
+    rec[10] = (data >> 16) & 0xff;
+    rec[11] = (data >> 24) & 0xff;
+
+    if(fwrite(rec, sizeof(rec), 1, record_file) != 1) {
+        LV_LOG_ERROR("can't write the input recording");
+        sdl_record_stop();
+    }
+}
+
+static bool rec_event_read(FILE * f, rec_event_t * rec)
+{
+    uint8_t buf[SDL_REC_SIZE];
+    if(fread(buf, sizeof(buf), 1, f) != 1) return false;
+
+    rec->time = buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((uint32_t)buf[3] << 24);
+    rec->type = buf[4];
+    rec->window = buf[5];
+    rec->pressed = buf[6];
+    rec->data = buf[8] | (buf[9] << 8) | (buf[10] << 16) | ((uint32_t)buf[11] << 24);
+
+    return true;
+}
+
+/**
+ * Apply the recorded events that are due.
+ * Only one button change is applied at a time, the next one is held back until
+ * LVGL read the state, else a press and its release could cancel each other out.
+ * @return milliseconds until the next recorded event
+ */
+static uint32_t replay_process(void)
+{
+    if(replay_file == NULL) return LV_NO_TIMER_READY;
+
+    bool applied = false;
+    bool button_changed = false;
+    uint32_t elapsed = sdl_tick_get() - replay_start;
+    replay_held = false;
+    while(replay_next.time <= elapsed) {
+        monitor_t * m;
+        for(m = monitor_list; m; m = m->next) {
+            if(m->index == replay_next.window) break;
+        }
+
+        if(m) {
+            bool button_change = false;
+            if(replay_next.type == SDL_REC_MOUSE) {
+                button_change = (replay_next.pressed != 0) != m->left_button_down;
+            }
+            else if(replay_next.type == SDL_REC_WHEEL_BTN) {
+                button_change = (replay_next.pressed != 0) != (m->wheel_state == LV_INDEV_STATE_PRESSED);
+            }
+
+            if(button_change && button_changed) {
+                replay_held = true;
+                break;
+            }
+            button_changed = button_changed || button_change;
+
+            switch(replay_next.type) {
+                case SDL_REC_MOUSE:
+                    m->last_x = (int16_t)(replay_next.data & 0xffff);
+                    m->last_y = (int16_t)(replay_next.data >> 16);
+                    m->left_button_down = replay_next.pressed != 0;
+                    break;
+                case SDL_REC_WHEEL:
+                    m->wheel_diff += (int16_t)replay_next.data;
+                    break;
+                case SDL_REC_WHEEL_BTN:
+                    m->wheel_state = replay_next.pressed ? LV_INDEV_STATE_PRESSED : LV_INDEV_STATE_RELEASED;
+                    break;
+                case SDL_REC_KEY:
+                    if(!key_ring_push(&m->keys, replay_next.data)) LV_LOG_WARN("key buffer full");
+                    break;
+                default:
+                    break;
+            }
+            applied = true;
+        }
+
+        if(!rec_event_read(replay_file, &replay_next)) {
+            sdl_replay_stop();
+            break;
+        }
+    }
+
+    /*Don't wait for the read period to pass the events to LVGL*/
+    if(applied) indev_read_ready();
+
+    if(replay_file == NULL) return LV_NO_TIMER_READY;
+    if(replay_held) return 0;
+    return replay_next.time - elapsed;
+}
+
+/**
+ * Add a key event to a queue. Can be called from another thread than `key_ring_pop()`.
+ * @param r the queue
+ * @param ev the key event
+ * @return false if the queue is full
+ */
+static bool key_ring_push(key_ring_t * r, uint32_t ev)
+{
+    uint32_t head = (uint32_t)SDL_AtomicGet(&r->head);
+    uint32_t tail = (uint32_t)SDL_AtomicGet(&r->tail);
+    if(head - tail >= SDL_KEY_BUF_SIZE) return false;
+
+    r->ev[head & (SDL_KEY_BUF_SIZE - 1)] = ev;
+
+    /*Publish the event only after it's written*/
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&r->head, (int)(head + 1));
+
+    return true;
+}
+
+/**
+ * Take the oldest key event from a queue
+ * @param r the queue
+ * @param ev store the key event here
+ * @return false if the queue is empty
+ */
+static bool key_ring_pop(key_ring_t * r, uint32_t * ev)
+{
+    uint32_t tail = (uint32_t)SDL_AtomicGet(&r->tail);
+    uint32_t head = (uint32_t)SDL_AtomicGet(&r->head);
+    if(head == tail) return false;
+
+    SDL_MemoryBarrierAcquire();
+    *ev = r->ev[tail & (SDL_KEY_BUF_SIZE - 1)];
+
+    /*Free the slot only after it's read*/
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&r->tail, (int)(tail + 1));
+
+    return true;
+}
+
+static bool key_ring_is_empty(key_ring_t * r)
+{
+    return SDL_AtomicGet(&r->head) == SDL_AtomicGet(&r->tail);
+}
+
+/**
+ * Decode the next UTF-8 character
+ * @param txt pointer to the text, moved to the next character
+ * @return the Unicode code point or 0 if the sequence is invalid
+ */
+static uint32_t utf8_decode(const char ** txt)
+{
+    const uint8_t * s = (const uint8_t *)*txt;
+    uint32_t cp;
+    uint32_t len;
 
+    if(s[0] < 0x80) {
+        cp = s[0];
+        len = 1;
     }
+    else if((s[0] & 0xE0) == 0xC0) {
+        cp = s[0] & 0x1F;
+        len = 2;
+    }
+    else if((s[0] & 0xF0) == 0xE0) {
+        cp = s[0] & 0x0F;
+        len = 3;
+    }
+    else if((s[0] & 0xF8) == 0xF0) {
+        cp = s[0] & 0x07;
+        len = 4;
+    }
+    else {
+        *txt += 1;
+        return 0;
+    }
+
+    uint32_t i;
+    for(i = 1; i < len; i++) {
+        if((s[i] & 0xC0) != 0x80) {
+            *txt += i;
+            return 0;
+        }
+        cp = (cp << 6) | (s[i] & 0x3F);
+    }
+
+    *txt += len;
+    return cp;
+}
+
+/**
+ * Pack a code point the way LVGL expects keys: the UTF-8 bytes with the first one in the lowest byte
+ * @param cp Unicode code point
+ * @return the packed UTF-8 bytes
+ */
+static uint32_t utf8_pack(uint32_t cp)
+{
+    if(cp < 0x80) return cp;
+    if(cp < 0x800) {
+        return (0xC0 | (cp >> 6)) |
+               ((0x80 | (cp & 0x3F)) << 8);
+    }
+    if(cp < 0x10000) {
+        return (0xE0 | (cp >> 12)) |
+               ((0x80 | ((cp >> 6) & 0x3F)) << 8) |
+               ((0x80 | (cp & 0x3F)) << 16);
+    }
+    return (0xF0 | (cp >> 18)) |
+           ((0x80 | ((cp >> 12) & 0x3F)) << 8) |
+           ((0x80 | ((cp >> 6) & 0x3F)) << 16) |
+           ((uint32_t)(0x80 | (cp & 0x3F)) << 24);
 }
 
 
@@ -620,6 +2272,7 @@ static uint32_t keycode_to_ctrl_key(SDL_Keycode sdl_key)
 }
 
 
+#if SDL_TICK_SOURCE == SDL_TICK_THREAD
 /**
  * A task to measure the elapsed time for LVGL
  * @param data unused
@@ -629,13 +2282,18 @@ static int tick_thread(void *data)
 {
     (void)data;
 
+    uint32_t last = SDL_GetTicks();
     while(1) {
         SDL_Delay(5);
-        lv_tick_inc(5); /*Tell LittelvGL that 5 milliseconds were elapsed*/
+        /*Pass the measured time, SDL_Delay() can sleep longer than asked*/
+        uint32_t now = SDL_GetTicks();
+        lv_tick_inc(now - last); /*Tell LittelvGL how many milliseconds were elapsed*/
+        last = now;
     }
 
     return 0;
 }
+#endif
 
 
 #endif /*USE_MONITOR || USE_SDL*/
@@ -32,10 +32,36 @@ extern "C" {
 /*********************
  *      DEFINES
  *********************/
+/*Values of SDL_TICK_SOURCE*/
+#define SDL_TICK_THREAD     0
+#define SDL_TICK_MONOTONIC  1
+#define SDL_TICK_VIRTUAL    2
 
 /**********************
  *      TYPEDEFS
  **********************/
+/*Pinch and rotation done with several fingers*/
+typedef struct {
+    float pinch;            /*Change of the fingers' distance, normalized to the window size*/
+    float rotation;         /*Rotation in radians, positive is counter-clockwise*/
+    lv_point_t center;      /*Center of the fingers*/
+    uint16_t finger_cnt;    /*Number of fingers*/
+} sdl_gesture_t;
+
+/*Statistics of the last frames, the times are in microseconds*/
+typedef struct {
+    float fps;
+    uint32_t p50;           /*Median time spent on a frame*/
+    uint32_t p90;
+    uint32_t p99;
+    struct {
+        uint32_t render;    /*LVGL rendering, i.e. outside of the flushes*/
+        uint32_t flush;     /*Copying the flushed areas to the frame buffer*/
+        uint32_t upload;    /*Uploading the dirty areas to the texture*/
+        uint32_t copy;      /*SDL_RenderCopy*/
+        uint32_t present;   /*SDL_RenderPresent*/
+    } avg;
+} sdl_frame_stats_t;
 
 /**********************
  * GLOBAL PROTOTYPES
@@ -46,6 +72,32 @@ extern "C" {
  */
 void sdl_init(void);
 
+/**
+ * Open a window for a display driver.
+ * Sets `hor_res`, `ver_res` and `flush_cb` of the driver, so call it
+ * after `lv_disp_drv_init()` and before `lv_disp_drv_register()`.
+ * @param disp_drv pointer to the display driver to show in the window
+ * @param hor_res horizontal resolution of the display
+ * @param ver_res vertical resolution of the display
+ * @param zoom initial scale of the window, can be fractional. The window can be resized later.
+ * @return true on success
+ */
+bool sdl_window_create(lv_disp_drv_t * disp_drv, lv_coord_t hor_res, lv_coord_t ver_res, float zoom);
+
+/**
+ * Resize the window of a display
+ * @param disp pointer to an SDL display or NULL to use the default display
+ * @param zoom the new scale of the window, can be fractional
+ */
+void sdl_window_set_zoom(lv_disp_t * disp, float zoom);
+
+/**
+ * Call `lv_timer_handler()` and sleep until the next LVGL timer is due or an SDL event arrives.
+ * Use it in the main loop instead of `lv_timer_handler()` and a fixed delay:
+ * input is handled as soon as it arrives and the CPU stays idle between frames.
+ */
+void sdl_timer_handler(void);
+
 /**
  * Flush a buffer to the marked area
  * @param drv pointer to driver where this function belongs
@@ -83,6 +135,128 @@ void sdl_mousewheel_read(lv_indev_drv_t * indev_drv, lv_indev_data_t * data);
  */
 void sdl_keyboard_read(lv_indev_drv_t * indev_drv, lv_indev_data_t * data);
 
+/**
+ * Get the first finger touching the window as a pointer.
+ * While a touch input device is registered, `sdl_mouse_read()` ignores the mouse events SDL makes from touches.
+ * @param indev_drv pointer to the related input device driver
+ * @param data store the touch data here
+ */
+void sdl_touch_read(lv_indev_drv_t * indev_drv, lv_indev_data_t * data);
+
+/**
+ * Get the position of every finger touching a display's window
+ * @param disp pointer to an SDL display or NULL to use the default display
+ * @param points store the points here
+ * @param max size of `points`
+ * @return number of points stored
+ */
+uint32_t sdl_touch_get_points(lv_disp_t * disp, lv_point_t * points, uint32_t max);
+
+/**
+ * Get the pinch and rotation done on a display's window since the last call
+ * @param disp pointer to an SDL display or NULL to use the default display
+ * @param gesture store the gesture here
+ * @return true if there was a multi-finger gesture since the last call
+ */
+bool sdl_touch_get_gesture(lv_disp_t * disp, sdl_gesture_t * gesture);
+
+/**
+ * Get the frame buffer of a display.
+ * Pixels are stored in the texture's format (ARGB8888, RGB565 or RGB332 depending on
+ * LV_COLOR_DEPTH) with a stride of the display's horizontal resolution.
+ * @param disp pointer to an SDL display or NULL to use the default display
+ * @return pointer to the frame buffer or NULL if nothing was rendered yet
+ */
+const void * sdl_get_fb(lv_disp_t * disp);
+
+/**
+ * Calculate the FNV-1a hash of a display's frame buffer to compare it with a known good frame.
+ * @param disp pointer to an SDL display or NULL to use the default display
+ * @return the hash or 0 if there is no frame buffer
+ */
+uint32_t sdl_fb_hash(lv_disp_t * disp);
+
+/**
+ * Save a display's frame buffer as a binary PPM image
+ * @param disp pointer to an SDL display or NULL to use the default display
+ * @param path path of the file to write
+ * @return true on success
+ */
+bool sdl_fb_save_ppm(lv_disp_t * disp, const char * path);
+
+/**
+ * Save a display's frame buffer as an RGB PNG image.
+ * The pixels are stored without compression, so no zlib or libpng is needed.
+ * @param disp pointer to an SDL display or NULL to use the default display
+ * @param path path of the file to write
+ * @return true on success
+ */
+bool sdl_fb_save_png(lv_disp_t * disp, const char * path);
+
+/**
+ * Get the milliseconds elapsed from the selected tick source.
+ * SDL starts counting on the first read, so it can be used as `LV_TICK_CUSTOM_SYS_TIME_EXPR`
+ * even though `lv_init()` reads the tick before `sdl_init()`.
+ * @return the elapsed milliseconds
+ */
+uint32_t sdl_tick_get(void);
+
+/**
+ * Advance the virtual clock. Only has effect with `SDL_TICK_SOURCE == SDL_TICK_VIRTUAL`.
+ * @param ms milliseconds to add
+ */
+void sdl_tick_advance(uint32_t ms);
+
+/**
+ * Start recording the mouse, mouse wheel and keyboard input of all windows to a file
+ * @param path path of the file to write
+ * @return true on success
+ */
+bool sdl_record_start(const char * path);
+
+/**
+ * Stop recording and close the file
+ */
+void sdl_record_stop(void);
+
+/**
+ * Replay the input saved by `sdl_record_start()` with the original timing.
+ * The time is measured with `sdl_tick_get()`, so with `SDL_TICK_VIRTUAL` the replay runs
+ * as fast as the application advances the clock.
+ * @param path path of the recording
+ * @return true on success
+ */
+bool sdl_replay_start(const char * path);
+
+/**
+ * Stop replaying and close the file
+ */
+void sdl_replay_stop(void);
+
+/**
+ * Tell whether a replay is in progress
+ * @return true until all the recorded events are replayed
+ */
+bool sdl_replay_is_running(void);
+
+/**
+ * Get the statistics of the last frames of a display.
+ * Only available with `SDL_FRAME_STATS 1`.
+ * @param disp pointer to an SDL display or NULL to use the default display
+ * @param stats store the statistics here
+ * @return false if no frame was shown yet
+ */
+bool sdl_frame_stats_get(lv_disp_t * disp, sdl_frame_stats_t * stats);
+
+/**
+ * Write the stage times of every frame of a display to a CSV file.
+ * Only available with `SDL_FRAME_STATS 1`.
+ * @param disp pointer to an SDL display or NULL to use the default display
+ * @param path path of the file to write or NULL to stop writing
+ * @return true on success
+ */
+bool sdl_frame_stats_csv(lv_disp_t * disp, const char * path);
+
 /*For backward compatibility. Will be removed.*/
 #define monitor_init sdl_init
 #define monitor_flush sdl_display_flush
@@ -0,0 +1,123 @@
+/**
+ * @file drm_tile_bench.c
+ * Compare the throughput of copying a frame into a linear and into the
+ * tiled framebuffer layouts supported by the DRM driver.
+ * All the layouts go through drm_tile_image(), which uses the row copy of
+ * drm_flush(), so no DRM device is needed to run it.
+ *
+ * Usage: drm_tile_bench [width] [height] [frames]
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <drm_fourcc.h>
+#include "lv_drivers/display/drm.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+#define BENCH_CPP 4 /* XRGB8888, converted from RGB565 with LV_COLOR_DEPTH 16 */
+
+#define DIV_ROUND_UP(n, d) (((n) + (d) - 1) / (d))
+#define ALIGN_UP(n, a) (DIV_ROUND_UP(n, a) * (a))
+#define ARRAY_SIZE(arr) (sizeof(arr) / sizeof((arr)[0]))
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+struct bench_layout {
+	const char *name;
+	uint64_t modifier;
+	uint32_t tile_w; /* bytes */
+	uint32_t tile_h; /* rows */
+};
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+static const struct bench_layout layouts[] = {
+	{ "linear", DRM_FORMAT_MOD_LINEAR, 64, 1 },
+	{ "X-tiled", I915_FORMAT_MOD_X_TILED, 512, 8 },
+	{ "Y-tiled", I915_FORMAT_MOD_Y_TILED, 128, 32 },
+};
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+static double bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+int main(int argc, char **argv)
+{
+	uint32_t width = argc > 1 ? strtoul(argv[1], NULL, 0) : 1920;
+	uint32_t height = argc > 2 ? strtoul(argv[2], NULL, 0) : 1080;
+	uint32_t frames = argc > 3 ? strtoul(argv[3], NULL, 0) : 200;
+	uint32_t src_pitch = width * sizeof(lv_color_t);
+	uint32_t i, f;
+	uint8_t *src;
+
+	if (!width || !height || !frames) {
+		fprintf(stderr, "usage: %s [width] [height] [frames]\n", argv[0]);
+		return 1;
+	}
+
+	src = malloc((size_t)src_pitch * height);
+	if (!src) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+
+	for (i = 0; i < src_pitch * height; i++)
+		src[i] = i * 7;
+
+	printf("%ux%u, %d bit to XRGB8888, %u frames\n", width, height, LV_COLOR_DEPTH, frames);
+
+	for (i = 0; i < ARRAY_SIZE(layouts); i++) {
+		const struct bench_layout *l = &layouts[i];
+		uint32_t pitch = ALIGN_UP(width * BENCH_CPP, l->tile_w);
+		size_t size = (size_t)pitch * ALIGN_UP(height, l->tile_h);
+		double t;
+		void *dst;
+
+		dst = malloc(size);
+		if (!dst) {
+			fprintf(stderr, "out of memory\n");
+			break;
+		}
+
+		/* Warm up the caches and fault the pages in */
+		if (drm_tile_image(l->modifier, dst, pitch, src, src_pitch, width, height, BENCH_CPP)) {
+			printf("%-8s not supported\n", l->name);
+			free(dst);
+			continue;
+		}
+
+		t = bench_now();
+		for (f = 0; f < frames; f++)
+			drm_tile_image(l->modifier, dst, pitch, src, src_pitch, width, height, BENCH_CPP);
+		t = bench_now() - t;
+
+		printf("%-8s %9.1f MB/s %8.3f ms/frame\n", l->name,
+		       (double)width * BENCH_CPP * height * frames / t / 1e6, t * 1e3 / frames);
+
+		free(dst);
+	}
+
+	free(src);
+
+	return 0;
+}
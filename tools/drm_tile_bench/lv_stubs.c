@@ -0,0 +1,58 @@
+/**
+ * @file lv_stubs.c
+ * The LVGL functions referenced by the DRM driver. The benchmark only calls
+ * drm_tile_image(), which needs none of them, so LVGL doesn't have to be built.
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include <stddef.h>
+#include "lv_drivers/display/drm.h"
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+lv_timer_t * lv_timer_create(lv_timer_cb_t timer_xcb, uint32_t period, void * user_data)
+{
+	return NULL;
+}
+
+void lv_timer_del(lv_timer_t * timer)
+{
+}
+
+void lv_timer_pause(lv_timer_t * timer)
+{
+}
+
+void lv_timer_resume(lv_timer_t * timer)
+{
+}
+
+void lv_disp_flush_ready(lv_disp_drv_t * disp_drv)
+{
+}
+
+void lv_disp_drv_update(lv_disp_t * disp, lv_disp_drv_t * new_drv)
+{
+}
+
+lv_disp_t * lv_disp_get_next(lv_disp_t * disp)
+{
+	return NULL;
+}
+
+uint32_t lv_disp_get_inactive_time(const lv_disp_t * disp)
+{
+	return 0;
+}
+
+lv_obj_t * lv_disp_get_scr_act(lv_disp_t * disp)
+{
+	return NULL;
+}
+
+void lv_obj_invalidate(const lv_obj_t * obj)
+{
+}
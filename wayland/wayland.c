@@ -6,6 +6,9 @@
 /*********************
  *      INCLUDES
  *********************/
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* needed for memfd_create() */
+#endif
 #include "wayland.h"
 
 #if USE_WAYLAND
@@ -15,10 +18,12 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <assert.h>
 #include <errno.h>
+#include <poll.h>
 #include <pthread.h>
 
 #include <sys/mman.h>
@@ -28,14 +33,69 @@
 #include <wayland-client.h>
 #include <xkbcommon/xkbcommon.h>
 
+#if WAYLAND_XDG_SHELL
+#include "xdg-shell-client-protocol.h"
+#endif
+
+#if WAYLAND_DMABUF
+#include <sys/ioctl.h>
+#include <linux/udmabuf.h>
+#include <drm_fourcc.h>
+#include "linux-dmabuf-unstable-v1-client-protocol.h"
+#endif
+
 /*********************
  *      DEFINES
  *********************/
+#ifndef WAYLAND_BUF_CNT
+#define WAYLAND_BUF_CNT 2
+#endif
+
+/* The compositor may hold the shown buffer until the next one is attached,
+ * so a single buffer could never be drawn again */
+#if (WAYLAND_BUF_CNT < 2) || (WAYLAND_BUF_CNT > 3)
+#error "WAYLAND_BUF_CNT must be 2 or 3"
+#endif
+
+#ifndef WAYLAND_XDG_SHELL
+#define WAYLAND_XDG_SHELL 0
+#endif
+
+#ifndef WAYLAND_INPUT_QUEUE_SIZE
+#define WAYLAND_INPUT_QUEUE_SIZE 32
+#endif
+
+#ifndef WAYLAND_DISPATCH_THREAD
+#define WAYLAND_DISPATCH_THREAD 1
+#endif
+
+#ifndef WAYLAND_DMABUF
+#define WAYLAND_DMABUF 0
+#endif
+
+#define BYTES_PER_PIXEL ((LV_COLOR_DEPTH + 7) / 8)
+
+/* Period of `frame_timer` while the frame callback is expected */
+#define FRAME_WAIT_PERIOD 1 /*ms*/
 
 /**********************
  *      TYPEDEFS
  **********************/
 
+struct input_item {
+    lv_coord_t x;
+    lv_coord_t y;
+    lv_key_t key;
+    lv_indev_state_t state;
+};
+
+/* Presses and releases not read by LVGL yet */
+struct input_queue {
+    struct input_item events[WAYLAND_INPUT_QUEUE_SIZE];
+    uint32_t head;
+    uint32_t cnt;
+};
+
 struct input {
     struct {
         lv_coord_t x;
@@ -44,20 +104,39 @@ struct input {
         lv_indev_state_t right_button;
         lv_indev_state_t wheel_button;
         int16_t wheel_diff;
+        struct input_queue queue;       /* Left button */
+        struct input_queue wheel_queue; /* Wheel button */
     } mouse;
 
     struct {
         lv_key_t key;
         lv_indev_state_t state;
+        struct input_queue queue;
     } keyboard;
 
     struct {
         lv_coord_t x;
         lv_coord_t y;
         lv_indev_state_t state;
+        struct input_queue queue;
     } touch;
 };
 
+struct buffer {
+    struct wl_buffer *wl_buffer;
+    void *data;
+    bool busy;              /* Held by the compositor until wl_buffer.release */
+    bool stale;             /* `stale_area` was changed in an other buffer */
+    lv_area_t stale_area;
+};
+
+#if WAYLAND_DMABUF
+/* Answer of the compositor to a zwp_linux_buffer_params_v1.create request */
+struct dmabuf_result {
+    struct wl_buffer *wl_buffer;    /* NULL if the compositor rejected the dma-buf */
+};
+#endif
+
 struct seat {
     struct application *application;
     struct wl_seat *wl_seat;
@@ -76,39 +155,129 @@ struct application {
     struct wl_registry *registry;
     struct wl_compositor *compositor;
     struct wl_shm *shm;
-    struct wl_buffer *buffer;
     struct wl_surface *surface;
 
     struct wl_shell *shell;
     struct wl_shell_surface *shell_surface;
 
+#if WAYLAND_XDG_SHELL
+    struct xdg_wm_base *xdg_wm_base;
+    struct xdg_surface *xdg_surface;
+    struct xdg_toplevel *xdg_toplevel;
+#endif
+
+#if WAYLAND_DMABUF
+    struct zwp_linux_dmabuf_v1 *dmabuf;
+    int udmabuf;                    /* /dev/udmabuf to turn memfds into dma-bufs */
+    uint32_t dmabuf_formats[4];     /* Usable formats with linear layout */
+    int dmabuf_format_cnt;
+    bool dmabuf_rejected;           /* A dma-buf failed, only wl_shm buffers are created from now on */
+#endif
+
+    struct wl_output *output;
+    int output_width;               /* Size of the output's current mode */
+    int output_height;
+
+    /* Size asked by the shell, applied to the buffers and LVGL by `frame_timer` */
+    struct {
+        bool pending;
+        int width;                  /* 0 to keep the current size */
+        int height;
+        uint32_t serial;
+        bool windowed;              /* Neither fullscreen nor maximized */
+        int windowed_width;         /* Last size as a normal window, 0 before the first one */
+        int windowed_height;
+    } configure;
+
     int width;
     int height;
     uint32_t format;
+    int stride;                     /* Bytes in a line of a buffer */
+
     void *data;
+    size_t data_size;
+    struct buffer buffers[WAYLAND_BUF_CNT];
+    struct buffer *draw_buffer;     /* Buffer the current refresh is flushed to */
+    struct buffer *last_buffer;     /* Buffer committed last, it has the newest content */
+    bool frame_dirty;
+    lv_area_t frame_area;           /* Union of the areas flushed in the current refresh */
+
+    lv_disp_t *disp;
+    lv_timer_t *frame_timer;
+    struct wl_callback *frame_callback;
+    bool frame_pending;             /* Waiting for the compositor to ask for the next frame */
+    bool frame_done;                /* Set by the frame callback, handled in `frame_timer` */
+    uint32_t frame_commit_tick;     /* When the pending frame was committed */
+
+    volatile bool close_requested;  /* The compositor asked to close the window */
 
     struct xkb_context *xkb_context;
     struct seat seat;
     struct input input;
 
+#if WAYLAND_DISPATCH_THREAD
     pthread_t thread;
     pthread_mutex_t mutex;
+    pthread_cond_t buffer_released;
+#endif
 };
 
 /**********************
  *  STATIC PROTOTYPES
  **********************/
+#if WAYLAND_DISPATCH_THREAD
 static void * wayland_dispatch_handler(void *data);
+#endif
 static void handle_global(void *data, struct wl_registry *registry, uint32_t name,
                           const char *interface, uint32_t version);
 static void handle_global_remove(void *data, struct wl_registry *registry, uint32_t name);
 
 static void shm_format(void *data, struct wl_shm *wl_shm, uint32_t format);
 
+static int shm_file_create(size_t size, bool *sealed);
+static bool buffers_create(struct application *app);
+#if WAYLAND_DMABUF
+static uint32_t dmabuf_format_from_shm(uint32_t shm_format);
+static void dmabuf_buffers_create(struct application *app, int fd, size_t buffer_size);
+static void dmabuf_handle_format(void *data, struct zwp_linux_dmabuf_v1 *dmabuf, uint32_t format);
+static void dmabuf_handle_modifier(void *data, struct zwp_linux_dmabuf_v1 *dmabuf, uint32_t format,
+                                   uint32_t modifier_hi, uint32_t modifier_lo);
+static void dmabuf_params_handle_created(void *data, struct zwp_linux_buffer_params_v1 *params,
+                                         struct wl_buffer *wl_buffer);
+static void dmabuf_params_handle_failed(void *data, struct zwp_linux_buffer_params_v1 *params);
+#endif
+static void buffers_destroy(struct application *app);
+static struct buffer * buffer_acquire(struct application *app);
+static void buffer_copy_area(struct application *app, struct buffer *dst,
+                             const struct buffer *src, const lv_area_t *area);
+static void buffer_handle_release(void *data, struct wl_buffer *wl_buffer);
+static inline void buffer_copy_row(uint8_t *dst, const lv_color_t *src, int32_t len);
+static void frame_commit(struct application *app);
+static void frame_handle_done(void *data, struct wl_callback *callback, uint32_t time);
+static void frame_process(struct application *app);
+static uint32_t frame_refr_period(struct application *app);
+static void frame_timer_cb(lv_timer_t *timer);
+
 static void shell_handle_ping(void *data, struct wl_shell_surface *shell_surface, uint32_t serial);
 static void shell_handle_configure(void *data, struct wl_shell_surface *shell_surface,
                                    uint32_t edges, int32_t width, int32_t height);
 static void shell_handle_popup_done(void *data, struct wl_shell_surface *shell_surface);
+#if WAYLAND_XDG_SHELL
+static void xdg_wm_base_handle_ping(void *data, struct xdg_wm_base *xdg_wm_base, uint32_t serial);
+static void xdg_surface_handle_configure(void *data, struct xdg_surface *xdg_surface, uint32_t serial);
+static void xdg_toplevel_handle_configure(void *data, struct xdg_toplevel *xdg_toplevel,
+                                          int32_t width, int32_t height, struct wl_array *states);
+static void xdg_toplevel_handle_close(void *data, struct xdg_toplevel *xdg_toplevel);
+#endif
+static void surface_apply_configure(struct application *app);
+static void output_handle_geometry(void *data, struct wl_output *output, int32_t x, int32_t y,
+                                   int32_t physical_width, int32_t physical_height,
+                                   int32_t subpixel, const char *make, const char *model,
+                                   int32_t transform);
+static void output_handle_mode(void *data, struct wl_output *output, uint32_t flags,
+                               int32_t width, int32_t height, int32_t refresh);
+static void output_handle_done(void *data, struct wl_output *output);
+static void output_handle_scale(void *data, struct wl_output *output, int32_t factor);
 static void seat_handle_capabilities(void *data, struct wl_seat *wl_seat, enum wl_seat_capability caps);
 
 static void pointer_handle_enter(void *data, struct wl_pointer *pointer,
@@ -151,6 +320,10 @@ static void touch_handle_cancel(void *data, struct wl_touch *wl_touch);
 
 static lv_key_t keycode_xkb_to_lv(uint32_t xkb_key);
 
+static void input_queue_push(struct input_queue *queue, lv_coord_t x, lv_coord_t y,
+                             lv_key_t key, lv_indev_state_t state);
+static bool input_queue_pop(struct input_queue *queue, struct input_item *event);
+
 /**********************
  *  STATIC VARIABLES
  **********************/
@@ -163,12 +336,54 @@ struct wl_shm_listener shm_listener = {
     shm_format
 };
 
+static const struct wl_buffer_listener buffer_listener = {
+    buffer_handle_release
+};
+
+static const struct wl_callback_listener frame_listener = {
+    frame_handle_done
+};
+
+#if WAYLAND_DMABUF
+static const struct zwp_linux_dmabuf_v1_listener dmabuf_listener = {
+    dmabuf_handle_format,
+    dmabuf_handle_modifier
+};
+
+static const struct zwp_linux_buffer_params_v1_listener dmabuf_params_listener = {
+    dmabuf_params_handle_created,
+    dmabuf_params_handle_failed
+};
+#endif
+
 static const struct wl_shell_surface_listener shell_surface_listener = {
     shell_handle_ping,
     shell_handle_configure,
     shell_handle_popup_done
 };
 
+#if WAYLAND_XDG_SHELL
+static const struct xdg_wm_base_listener xdg_wm_base_listener = {
+    xdg_wm_base_handle_ping
+};
+
+static const struct xdg_surface_listener xdg_surface_listener = {
+    xdg_surface_handle_configure
+};
+
+static const struct xdg_toplevel_listener xdg_toplevel_listener = {
+    xdg_toplevel_handle_configure,
+    xdg_toplevel_handle_close
+};
+#endif
+
+static const struct wl_output_listener output_listener = {
+    output_handle_geometry,
+    output_handle_mode,
+    output_handle_done,
+    output_handle_scale
+};
+
 static const struct wl_seat_listener seat_listener = {
     seat_handle_capabilities,
 };
@@ -202,6 +417,14 @@ static struct application application;
 /**********************
  *      MACROS
  **********************/
+/* Protect the state shared with the dispatch thread */
+#if WAYLAND_DISPATCH_THREAD
+#define app_lock(app)   pthread_mutex_lock(&(app)->mutex)
+#define app_unlock(app) pthread_mutex_unlock(&(app)->mutex)
+#else
+#define app_lock(app)
+#define app_unlock(app)
+#endif
 
 /**********************
  *   GLOBAL FUNCTIONS
@@ -211,16 +434,10 @@ static struct application application;
  */
 void wayland_init(void)
 {
-    struct wl_shm_pool *pool;
-
-    int stride;
-    int size;
-
-    static const char template[] = "/lvgl-wayland-XXXXXX";
-    const char *path;
-    char *name;
-    int fd;
-    int ret;
+#if WAYLAND_DISPATCH_THREAD
+    pthread_mutex_init(&application.mutex, NULL);
+    pthread_cond_init(&application.buffer_released, NULL);
+#endif
 
     // Create XKB context
     application.xkb_context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
@@ -234,6 +451,10 @@ void wayland_init(void)
     application.display = wl_display_connect(NULL);
     assert(application.display);
 
+#if WAYLAND_DMABUF
+    application.udmabuf = -1;
+#endif
+
     // Create compositor surface
     application.width = WAYLAND_HOR_RES;
     application.height = WAYLAND_VER_RES;
@@ -251,82 +472,63 @@ void wayland_init(void)
         return;
     }
 
-    // Create buffer
-    stride = application.width * ((LV_COLOR_DEPTH + 7) / 8);
-    size = stride * application.height;
-
-    path = getenv("XDG_RUNTIME_DIR");
-    if (!path) {
-        LV_LOG_ERROR("cannot get XDG_RUNTIME_DIR: %s\n", strerror(errno));
-        return;
-    }
-
-    name = malloc(strlen(path) + sizeof(template));
-    if (!name) {
-        LV_LOG_ERROR("cannot malloc name: %s\n", strerror(errno));
-        return;
-    }
-
-    strcpy(name, path);
-    strcat(name, template);
-
-    fd = mkstemp(name);
-    if (fd >= 0) {
-        long flags = fcntl(fd, F_GETFD);
-        if ((flags == -1) || (fcntl(fd, F_SETFD, flags | FD_CLOEXEC) == -1)) {
-            LV_LOG_ERROR("cannot set FD_CLOEXEC\n");
-            close(fd);
-            fd = -1;
+#if WAYLAND_DMABUF
+    if (application.dmabuf) {
+        application.udmabuf = open("/dev/udmabuf", O_RDWR | O_CLOEXEC);
+        if (application.udmabuf < 0) {
+            LV_LOG_WARN("cannot open /dev/udmabuf, using wl_shm buffers\n");
         }
-        unlink(name);
     }
+#endif
 
-    free(name);
+    // Create compositor surface
+    application.surface = wl_compositor_create_surface(application.compositor);
+    wl_surface_set_user_data(application.surface, &application);
 
-    if (fd < 0) {
-        LV_LOG_ERROR("cannot create tmpfile: %s\n", strerror(errno));
-        return;
-    }
+#if WAYLAND_XDG_SHELL
+    if (application.xdg_wm_base) {
+        // Create xdg-shell surface
+        application.xdg_surface = xdg_wm_base_get_xdg_surface(application.xdg_wm_base,
+                                                              application.surface);
+        xdg_surface_add_listener(application.xdg_surface, &xdg_surface_listener, &application);
+
+        application.xdg_toplevel = xdg_surface_get_toplevel(application.xdg_surface);
+        xdg_toplevel_add_listener(application.xdg_toplevel, &xdg_toplevel_listener, &application);
+        xdg_toplevel_set_title(application.xdg_toplevel, WAYLAND_SURF_TITLE);
+
+        /* A buffer can be attached only after the first configure */
+        wl_surface_commit(application.surface);
+        wl_display_roundtrip(application.display);
+        surface_apply_configure(&application);
+    } else
+#endif
+    if (application.shell) {
+        // Create shell surface
+        application.shell_surface = wl_shell_get_shell_surface(application.shell, application.surface);
+        assert(application.shell_surface);
 
-    do {
-        ret = ftruncate(fd, size);
-    } while ((ret < 0) && (errno == EINTR));
-    if (ret < 0) {
-        LV_LOG_ERROR("ftruncate failed: %s\n", strerror(errno));
-        close(fd);
+        wl_shell_surface_add_listener(application.shell_surface, &shell_surface_listener, &application);
+        wl_shell_surface_set_toplevel(application.shell_surface);
+        wl_shell_surface_set_title(application.shell_surface, WAYLAND_SURF_TITLE);
+    } else {
+        LV_LOG_ERROR("no shell available\n");
         return;
     }
 
-    application.data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-    if (application.data == MAP_FAILED) {
-        LV_LOG_ERROR("mmap failed: %s\n", strerror(errno));
-        close(fd);
+    // Create buffers
+    if ((application.data == NULL) && !buffers_create(&application)) {
         return;
     }
 
-    pool = wl_shm_create_pool(application.shm, fd, size);
-    application.buffer = wl_shm_pool_create_buffer(pool, 0,
-                                                   application.width, application.height,
-                                                   stride,
-                                                   application.format);
-    wl_shm_pool_destroy(pool);
-
-    close(fd);
-
-    // Create compositor surface
-    application.surface = wl_compositor_create_surface(application.compositor);
-    wl_surface_set_user_data(application.surface, &application);
-
-    // Create shell surface
-    application.shell_surface = wl_shell_get_shell_surface(application.shell, application.surface);
-    assert(application.shell_surface);
-
-    wl_shell_surface_add_listener(application.shell_surface, &shell_surface_listener, &application);
-    wl_shell_surface_set_toplevel(application.shell_surface);
-    wl_shell_surface_set_title(application.shell_surface, WAYLAND_SURF_TITLE);
-
-    pthread_mutex_init(&application.mutex, NULL);
+#if WAYLAND_DISPATCH_THREAD
     pthread_create(&application.thread, NULL, wayland_dispatch_handler, &application);
+#endif
+
+    /* Frame callbacks and configure events are passed to LVGL by this timer.
+     * Without the dispatch thread it also reads the events. It runs every
+     * millisecond while a frame callback is expected and with the display's
+     * refresh period otherwise, so a hidden window doesn't keep the CPU busy. */
+    application.frame_timer = lv_timer_create(frame_timer_cb, LV_DISP_DEF_REFR_PERIOD, &application);
 }
 
 /**
@@ -334,11 +536,62 @@ void wayland_init(void)
  */
 void wayland_deinit(void)
 {
+#if WAYLAND_DISPATCH_THREAD
     pthread_cancel(application.thread);
 
     pthread_join(application.thread, NULL);
 
     pthread_mutex_destroy(&application.mutex);
+    pthread_cond_destroy(&application.buffer_released);
+#endif
+
+    if (application.frame_timer) {
+        lv_timer_del(application.frame_timer);
+        application.frame_timer = NULL;
+    }
+
+    if (application.frame_callback) {
+        wl_callback_destroy(application.frame_callback);
+        application.frame_callback = NULL;
+    }
+
+    buffers_destroy(&application);
+
+#if WAYLAND_XDG_SHELL
+    if (application.xdg_toplevel) {
+        xdg_toplevel_destroy(application.xdg_toplevel);
+    }
+
+    if (application.xdg_surface) {
+        xdg_surface_destroy(application.xdg_surface);
+    }
+
+    if (application.xdg_wm_base) {
+        xdg_wm_base_destroy(application.xdg_wm_base);
+    }
+#endif
+
+    if (application.shell_surface) {
+        wl_shell_surface_destroy(application.shell_surface);
+    }
+
+    if (application.surface) {
+        wl_surface_destroy(application.surface);
+    }
+
+    if (application.output) {
+        wl_output_destroy(application.output);
+    }
+
+#if WAYLAND_DMABUF
+    if (application.dmabuf) {
+        zwp_linux_dmabuf_v1_destroy(application.dmabuf);
+    }
+
+    if (application.udmabuf >= 0) {
+        close(application.udmabuf);
+    }
+#endif
 
     if (application.shm) {
         wl_shm_destroy(application.shm);
@@ -371,45 +624,214 @@ void wayland_flush(lv_disp_drv_t * disp_drv, const lv_area_t * area, lv_color_t
 {
     lv_coord_t hres = (disp_drv->rotated == 0) ? (disp_drv->hor_res) : (disp_drv->ver_res);
     lv_coord_t vres = (disp_drv->rotated == 0) ? (disp_drv->ver_res) : (disp_drv->hor_res);
+    lv_area_t flush_area;
 
-    /* Return if the area is out the screen */
+    /* Skip the area if it's out of the screen, but still commit the frame below */
     if ((area->x2 < 0) || (area->y2 < 0) || (area->x1 > hres - 1) || (area->y1 > vres - 1)) {
-        lv_disp_flush_ready(disp_drv);
-        return;
+        goto out;
+    }
+
+    /* No buffers, e.g. a resize failed to allocate them */
+    if (application.data == NULL) {
+        goto out;
+    }
+
+    /* Start to draw into a buffer which is not used by the compositor */
+    if (application.draw_buffer == NULL) {
+        application.draw_buffer = buffer_acquire(&application);
+        if (application.draw_buffer == NULL) {
+            goto out;
+        }
+    }
+
+    flush_area.x1 = LV_MAX(area->x1, 0);
+    flush_area.y1 = LV_MAX(area->y1, 0);
+    flush_area.x2 = LV_MIN(area->x2, LV_MIN(disp_drv->hor_res, application.width) - 1);
+    flush_area.y2 = LV_MIN(area->y2, LV_MIN(disp_drv->ver_res, application.height) - 1);
+    if ((flush_area.x2 < flush_area.x1) || (flush_area.y2 < flush_area.y1)) {
+        goto out;
     }
 
-    int32_t x;
+    const int32_t src_stride = lv_area_get_width(area);
+    const int32_t len = lv_area_get_width(&flush_area);
+    const lv_color_t *src = color_p + ((flush_area.y1 - area->y1) * src_stride) +
+                            (flush_area.x1 - area->x1);
+    uint8_t *dst = (uint8_t *)application.draw_buffer->data +
+                   (flush_area.y1 * application.stride) + (flush_area.x1 * BYTES_PER_PIXEL);
     int32_t y;
-    for (y = area->y1; y <= area->y2 && y < disp_drv->ver_res; y++) {
-        for (x = area->x1; x <= area->x2 && x < disp_drv->hor_res; x++) {
-            int offset = (y * disp_drv->hor_res) + x;
-#if (LV_COLOR_DEPTH == 32)
-            uint32_t * const buf = (uint32_t *)application.data + offset;
-            *buf = color_p->full;
-#elif (LV_COLOR_DEPTH == 16)
-            uint16_t * const buf = (uint16_t *)application.data + offset;
-            *buf = color_p->full;
-#elif (LV_COLOR_DEPTH == 8)
-            uint8_t * const buf = (uint8_t *)application.data + offset;
-            *buf = color_p->full;
-#elif (LV_COLOR_DEPTH == 1)
-            uint8_t * const buf = (uint8_t *)application.data + offset;
-            *buf = ((0x07 * color_p->ch.red)   << 5) |
-                   ((0x07 * color_p->ch.green) << 2) |
-                   ((0x03 * color_p->ch.blue)  << 0);
+
+    for (y = flush_area.y1; y <= flush_area.y2; y++) {
+        buffer_copy_row(dst, src, len);
+        dst += application.stride;
+        src += src_stride;
+    }
+
+    if (wl_surface_get_version(application.surface) >= WL_SURFACE_DAMAGE_BUFFER_SINCE_VERSION) {
+        wl_surface_damage_buffer(application.surface, flush_area.x1, flush_area.y1,
+                                 lv_area_get_width(&flush_area), lv_area_get_height(&flush_area));
+    } else {
+        wl_surface_damage(application.surface, flush_area.x1, flush_area.y1,
+                          lv_area_get_width(&flush_area), lv_area_get_height(&flush_area));
+    }
+
+    if (application.frame_dirty) {
+        _lv_area_join(&application.frame_area, &application.frame_area, &flush_area);
+    } else {
+        application.frame_area = flush_area;
+        application.frame_dirty = true;
+    }
+
+out:
+    if (application.disp == NULL) {
+        application.disp = _lv_refr_get_disp_refreshing();
+        if (application.disp && application.frame_timer && !application.frame_pending) {
+            lv_timer_set_period(application.frame_timer, frame_refr_period(&application));
+        }
+    }
+
+    /* Present the buffer once the whole refresh is drawn. If the compositor didn't ask for
+     * a new frame yet (e.g. after `lv_refr_now()`) the commit is done by `frame_timer`. */
+    if (lv_disp_flush_is_last(disp_drv) && application.frame_dirty && !application.frame_pending) {
+        frame_commit(&application);
+    }
+
+    lv_disp_flush_ready(disp_drv);
+}
+
+/**
+ * Get the file descriptor of the Wayland connection.
+ * With `WAYLAND_DISPATCH_THREAD 0` wait for it to be readable in the application's
+ * poll loop and call `wayland_dispatch()`.
+ * @return the file descriptor
+ */
+int wayland_get_fd(void)
+{
+    return wl_display_get_fd(application.display);
+}
+
+/**
+ * Read and handle the events of the Wayland connection without blocking.
+ * Only needed with `WAYLAND_DISPATCH_THREAD 0`; it's also called by `lv_timer_handler()`
+ * through `frame_timer`. A frame callback read here resumes the rendering right away.
+ * @return false if the connection is broken
+ */
+bool wayland_dispatch(void)
+{
+#if WAYLAND_DISPATCH_THREAD
+    return true;
+#else
+    struct wl_display *display = application.display;
+    struct pollfd pfd;
+    int ret;
+
+    /* Handle the events which are already queued before reading new ones */
+    while (wl_display_prepare_read(display) != 0) {
+        if (wl_display_dispatch_pending(display) < 0) {
+            return false;
+        }
+    }
+
+    /* Send the requests which might trigger the events */
+    ret = wl_display_flush(display);
+    if ((ret < 0) && (errno != EAGAIN)) {
+        wl_display_cancel_read(display);
+        return false;
+    }
+
+    pfd.fd = wl_display_get_fd(display);
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    if (poll(&pfd, 1, 0) > 0) {
+        if (wl_display_read_events(display) < 0) {
+            return false;
+        }
+    } else {
+        wl_display_cancel_read(display);
+    }
+
+    if (wl_display_dispatch_pending(display) < 0) {
+        return false;
+    }
+
+    frame_process(&application);
+
+    return true;
 #endif
-            color_p++;
+}
+
+/**
+ * Switch the window to fullscreen on the output's native resolution or back
+ * @param fullscreen true to enable fullscreen
+ */
+void wayland_set_fullscreen(bool fullscreen)
+{
+#if WAYLAND_XDG_SHELL
+    if (application.xdg_toplevel) {
+        if (fullscreen) {
+            xdg_toplevel_set_fullscreen(application.xdg_toplevel, application.output);
+        } else {
+            xdg_toplevel_unset_fullscreen(application.xdg_toplevel);
         }
+        return;
     }
+#endif
 
-    wl_surface_attach(application.surface, application.buffer, 0, 0);
-    wl_surface_damage(application.surface, area->x1, area->y1,
-                      (area->x2 - area->x1 + 1), (area->y2 - area->y1 + 1));
-    wl_surface_commit(application.surface);
+    if (application.shell_surface) {
+        /* wl_shell doesn't always suggest a size, use the output's mode */
+        app_lock(&application);
+        application.configure.width = fullscreen ? application.output_width : WAYLAND_HOR_RES;
+        application.configure.height = fullscreen ? application.output_height : WAYLAND_VER_RES;
+        application.configure.pending = true;
+        app_unlock(&application);
+
+        if (fullscreen) {
+            wl_shell_surface_set_fullscreen(application.shell_surface, 0, 0, application.output);
+        } else {
+            wl_shell_surface_set_toplevel(application.shell_surface);
+        }
+    }
+}
 
-    wl_display_flush(application.display);
+/**
+ * Maximize the window or restore its original size
+ * @param maximized true to maximize
+ */
+void wayland_set_maximized(bool maximized)
+{
+#if WAYLAND_XDG_SHELL
+    if (application.xdg_toplevel) {
+        if (maximized) {
+            xdg_toplevel_set_maximized(application.xdg_toplevel);
+        } else {
+            xdg_toplevel_unset_maximized(application.xdg_toplevel);
+        }
+        return;
+    }
+#endif
 
-    lv_disp_flush_ready(disp_drv);
+    if (application.shell_surface) {
+        if (maximized) {
+            wl_shell_surface_set_maximized(application.shell_surface, application.output);
+        } else {
+            app_lock(&application);
+            application.configure.width = WAYLAND_HOR_RES;
+            application.configure.height = WAYLAND_VER_RES;
+            application.configure.pending = true;
+            app_unlock(&application);
+
+            wl_shell_surface_set_toplevel(application.shell_surface);
+        }
+    }
+}
+
+/**
+ * Tell whether the user asked to close the window (e.g. with its close button).
+ * The window is not closed by the driver, call `wayland_deinit()` and exit when this is set.
+ * @return true once the compositor sent a close request
+ */
+bool wayland_is_close_requested(void)
+{
+    return application.close_requested;
 }
 
 /**
@@ -420,14 +842,22 @@ void wayland_flush(lv_disp_drv_t * disp_drv, const lv_area_t * area, lv_color_t
 void wayland_pointer_read(lv_indev_drv_t * drv, lv_indev_data_t * data)
 {
     (void) drv; /* Unused */
+    struct input_item event;
 
-    pthread_mutex_lock(&application.mutex);
+    app_lock(&application);
 
-    data->point.x = application.input.mouse.x;
-    data->point.y = application.input.mouse.y;
-    data->state = application.input.mouse.left_button;
+    if (input_queue_pop(&application.input.mouse.queue, &event)) {
+        data->point.x = event.x;
+        data->point.y = event.y;
+        data->state = event.state;
+    } else {
+        data->point.x = application.input.mouse.x;
+        data->point.y = application.input.mouse.y;
+        data->state = application.input.mouse.left_button;
+    }
+    data->continue_reading = (application.input.mouse.queue.cnt > 0);
 
-    pthread_mutex_unlock(&application.mutex);
+    app_unlock(&application);
 }
 
 /**
@@ -438,15 +868,21 @@ void wayland_pointer_read(lv_indev_drv_t * drv, lv_indev_data_t * data)
 void wayland_pointeraxis_read(lv_indev_drv_t * drv, lv_indev_data_t * data)
 {
     (void) drv; /* Unused */
+    struct input_item event;
 
-    pthread_mutex_lock(&application.mutex);
+    app_lock(&application);
 
-    data->state = application.input.mouse.wheel_button;
+    if (input_queue_pop(&application.input.mouse.wheel_queue, &event)) {
+        data->state = event.state;
+    } else {
+        data->state = application.input.mouse.wheel_button;
+    }
     data->enc_diff = application.input.mouse.wheel_diff;
+    data->continue_reading = (application.input.mouse.wheel_queue.cnt > 0);
 
     application.input.mouse.wheel_diff = 0;
 
-    pthread_mutex_unlock(&application.mutex);
+    app_unlock(&application);
 }
 
 /**
@@ -457,13 +893,20 @@ void wayland_pointeraxis_read(lv_indev_drv_t * drv, lv_indev_data_t * data)
 void wayland_keyboard_read(lv_indev_drv_t * drv, lv_indev_data_t * data)
 {
     (void) drv; /* Unused */
+    struct input_item event;
 
-    pthread_mutex_lock(&application.mutex);
+    app_lock(&application);
 
-    data->key = application.input.keyboard.key;
-    data->state = application.input.keyboard.state;
+    if (input_queue_pop(&application.input.keyboard.queue, &event)) {
+        data->key = event.key;
+        data->state = event.state;
+    } else {
+        data->key = application.input.keyboard.key;
+        data->state = application.input.keyboard.state;
+    }
+    data->continue_reading = (application.input.keyboard.queue.cnt > 0);
 
-    pthread_mutex_unlock(&application.mutex);
+    app_unlock(&application);
 }
 
 /**
@@ -474,19 +917,28 @@ void wayland_keyboard_read(lv_indev_drv_t * drv, lv_indev_data_t * data)
 void wayland_touch_read(lv_indev_drv_t * drv, lv_indev_data_t * data)
 {
     (void) drv; /* Unused */
+    struct input_item event;
 
-    pthread_mutex_lock(&application.mutex);
+    app_lock(&application);
 
-    data->point.x = application.input.touch.x;
-    data->point.y = application.input.touch.y;
-    data->state = application.input.touch.state;
+    if (input_queue_pop(&application.input.touch.queue, &event)) {
+        data->point.x = event.x;
+        data->point.y = event.y;
+        data->state = event.state;
+    } else {
+        data->point.x = application.input.touch.x;
+        data->point.y = application.input.touch.y;
+        data->state = application.input.touch.state;
+    }
+    data->continue_reading = (application.input.touch.queue.cnt > 0);
 
-    pthread_mutex_unlock(&application.mutex);
+    app_unlock(&application);
 }
 
 /**********************
  *   STATIC FUNCTIONS
  **********************/
+#if WAYLAND_DISPATCH_THREAD
 static void * wayland_dispatch_handler(void *data)
 {
     struct application *app = data;
@@ -497,6 +949,7 @@ static void * wayland_dispatch_handler(void *data)
 
     return (void *)0;
 }
+#endif
 
 static void handle_global(void *data, struct wl_registry *registry,
                           uint32_t name, const char *interface, uint32_t version)
@@ -504,9 +957,22 @@ static void handle_global(void *data, struct wl_registry *registry,
     struct application *app = data;
 
     if (strcmp(interface, "wl_compositor") == 0) {
-        app->compositor = wl_registry_bind(registry, name, &wl_compositor_interface, 1);
+        app->compositor = wl_registry_bind(registry, name, &wl_compositor_interface, LV_MIN(version, 4));
     } else if (strcmp(interface, "wl_shell") == 0) {
         app->shell = wl_registry_bind(registry, name, &wl_shell_interface, 1);
+#if WAYLAND_XDG_SHELL
+    } else if (strcmp(interface, "xdg_wm_base") == 0) {
+        app->xdg_wm_base = wl_registry_bind(registry, name, &xdg_wm_base_interface, 1);
+        xdg_wm_base_add_listener(app->xdg_wm_base, &xdg_wm_base_listener, app);
+#endif
+#if WAYLAND_DMABUF
+    } else if ((strcmp(interface, "zwp_linux_dmabuf_v1") == 0) && (version >= 3)) {
+        app->dmabuf = wl_registry_bind(registry, name, &zwp_linux_dmabuf_v1_interface, 3);
+        zwp_linux_dmabuf_v1_add_listener(app->dmabuf, &dmabuf_listener, app);
+#endif
+    } else if ((strcmp(interface, "wl_output") == 0) && !app->output) {
+        app->output = wl_registry_bind(registry, name, &wl_output_interface, LV_MIN(version, 2));
+        wl_output_add_listener(app->output, &output_listener, app);
     } else if (strcmp(interface, "wl_shm") == 0) {
         app->shm = wl_registry_bind(registry, name, &wl_shm_interface, 1);
         wl_shm_add_listener(app->shm, &shm_listener, app);
@@ -554,19 +1020,715 @@ static void shm_format(void *data, struct wl_shm *wl_shm, uint32_t format)
     }
 }
 
-static void shell_handle_ping(void *data, struct wl_shell_surface *shell_surface, uint32_t serial)
-{
-    wl_shell_surface_pong(shell_surface, serial);
-}
-
-static void shell_handle_configure(void *data, struct wl_shell_surface *shell_surface,
-                                   uint32_t edges, int32_t width, int32_t height)
+static int shm_file_create(size_t size, bool *sealed)
 {
-}
+    static const char template[] = "/lvgl-wayland-XXXXXX";
+    const char *path;
+    char *name;
+    int fd;
+    int ret;
 
-static void shell_handle_popup_done(void *data, struct wl_shell_surface *shell_surface)
-{
-}
+    *sealed = false;
+
+#ifdef MFD_ALLOW_SEALING
+    /* Anonymous file, sealed so the compositor can rely on its size */
+    fd = memfd_create("lvgl-wayland", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd >= 0) {
+        do {
+            ret = ftruncate(fd, size);
+        } while ((ret < 0) && (errno == EINTR));
+        if (ret < 0) {
+            LV_LOG_ERROR("ftruncate failed: %s\n", strerror(errno));
+            close(fd);
+            return -1;
+        }
+
+        /* An unsealed memfd still works for wl_shm, only udmabuf needs the seals */
+        const int seals = F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL;
+        if (fcntl(fd, F_ADD_SEALS, seals) < 0) {
+            LV_LOG_WARN("cannot seal the buffer file (%s), using it unsealed\n", strerror(errno));
+        } else if ((fcntl(fd, F_GET_SEALS) & seals) != seals) {
+            LV_LOG_WARN("the buffer file lacks the seals, using it unsealed\n");
+        } else {
+            *sealed = true;
+        }
+        return fd;
+    }
+#endif
+
+    /* Fall back to a file in XDG_RUNTIME_DIR */
+    path = getenv("XDG_RUNTIME_DIR");
+    if (!path) {
+        LV_LOG_ERROR("cannot get XDG_RUNTIME_DIR: %s\n", strerror(errno));
+        return -1;
+    }
+
+    name = malloc(strlen(path) + sizeof(template));
+    if (!name) {
+        LV_LOG_ERROR("cannot malloc name: %s\n", strerror(errno));
+        return -1;
+    }
+
+    strcpy(name, path);
+    strcat(name, template);
+
+    fd = mkstemp(name);
+    if (fd >= 0) {
+        long flags = fcntl(fd, F_GETFD);
+        if ((flags == -1) || (fcntl(fd, F_SETFD, flags | FD_CLOEXEC) == -1)) {
+            LV_LOG_ERROR("cannot set FD_CLOEXEC\n");
+            close(fd);
+            fd = -1;
+        }
+        unlink(name);
+    }
+
+    free(name);
+
+    if (fd < 0) {
+        LV_LOG_ERROR("cannot create tmpfile: %s\n", strerror(errno));
+        return -1;
+    }
+
+    do {
+        ret = ftruncate(fd, size);
+    } while ((ret < 0) && (errno == EINTR));
+    if (ret < 0) {
+        LV_LOG_ERROR("ftruncate failed: %s\n", strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static bool buffers_create(struct application *app)
+{
+    struct wl_shm_pool *pool = NULL;
+    bool sealed;
+    int fd;
+    int i;
+
+    /* Page aligned buffers, as required for dma-bufs */
+    const size_t page_size = sysconf(_SC_PAGESIZE);
+    app->stride = app->width * BYTES_PER_PIXEL;
+    const size_t buffer_size = ((size_t)app->stride * app->height + page_size - 1) & ~(page_size - 1);
+
+    app->data_size = buffer_size * WAYLAND_BUF_CNT;
+
+    fd = shm_file_create(app->data_size, &sealed);
+    if (fd < 0) {
+        return false;
+    }
+
+    app->data = mmap(NULL, app->data_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (app->data == MAP_FAILED) {
+        LV_LOG_ERROR("mmap failed: %s\n", strerror(errno));
+        app->data = NULL;
+        close(fd);
+        return false;
+    }
+
+#if WAYLAND_DMABUF
+    /* Works only with a sealed memfd, a tmpfile uses wl_shm */
+    if (sealed) {
+        dmabuf_buffers_create(app, fd, buffer_size);
+    }
+#else
+    (void)sealed;
+#endif
+
+    /* All the buffers share one file, each one has its own slice of it */
+    for (i = 0; i < WAYLAND_BUF_CNT; i++) {
+        struct buffer *buffer = &app->buffers[i];
+
+        buffer->data = (uint8_t *)app->data + (buffer_size * i);
+        buffer->busy = false;
+        buffer->stale = false;
+        if (buffer->wl_buffer == NULL) {
+            if (pool == NULL) {
+                pool = wl_shm_create_pool(app->shm, fd, app->data_size);
+            }
+            buffer->wl_buffer = wl_shm_pool_create_buffer(pool, buffer_size * i,
+                                                          app->width, app->height,
+                                                          app->stride,
+                                                          app->format);
+        }
+        wl_buffer_add_listener(buffer->wl_buffer, &buffer_listener, app);
+    }
+
+    if (pool) {
+        wl_shm_pool_destroy(pool);
+    }
+
+    close(fd);
+
+    app->draw_buffer = NULL;
+    app->last_buffer = NULL;
+    app->frame_dirty = false;
+
+    return true;
+}
+
+#if WAYLAND_DMABUF
+static uint32_t dmabuf_format_from_shm(uint32_t shm_format)
+{
+    switch (shm_format) {
+    case WL_SHM_FORMAT_ARGB8888:
+        return DRM_FORMAT_ARGB8888;
+    case WL_SHM_FORMAT_XRGB8888:
+        return DRM_FORMAT_XRGB8888;
+    default:
+        /* The other wl_shm formats use the DRM fourcc codes */
+        return shm_format;
+    }
+}
+
+/* Turn the buffers into dma-bufs, with a single roundtrip for all of them.
+ * The buffers the compositor rejected are left for wl_shm. */
+static void dmabuf_buffers_create(struct application *app, int fd, size_t buffer_size)
+{
+    struct zwp_linux_buffer_params_v1 *params[WAYLAND_BUF_CNT] = { NULL };
+    struct dmabuf_result results[WAYLAND_BUF_CNT];
+    struct udmabuf_create create;
+    struct wl_event_queue *queue;
+    const uint32_t format = dmabuf_format_from_shm(app->format);
+    bool supported = false;
+    bool sent = false;
+    int dmabuf_fd;
+    int i;
+
+    if (!app->dmabuf || (app->udmabuf < 0) || app->dmabuf_rejected) {
+        return;
+    }
+
+    for (i = 0; i < app->dmabuf_format_cnt; i++) {
+        if (app->dmabuf_formats[i] == format) {
+            supported = true;
+        }
+    }
+    if (!supported) {
+        return;
+    }
+
+    /* Wait for the compositor to import the dma-bufs: attaching a buffer it rejected
+     * would be a fatal protocol error. The answers are read on a private queue, so
+     * they don't mix with the events handled by the dispatch thread. */
+    queue = wl_display_create_queue(app->display);
+
+    for (i = 0; i < WAYLAND_BUF_CNT; i++) {
+        results[i].wl_buffer = NULL;
+
+        memset(&create, 0, sizeof(create));
+        create.memfd = fd;
+        create.flags = UDMABUF_FLAGS_CLOEXEC;
+        create.offset = buffer_size * i;
+        create.size = buffer_size;
+        dmabuf_fd = ioctl(app->udmabuf, UDMABUF_CREATE, &create);
+        if (dmabuf_fd < 0) {
+            app->dmabuf_rejected = true;
+            continue;
+        }
+
+        params[i] = zwp_linux_dmabuf_v1_create_params(app->dmabuf);
+        wl_proxy_set_queue((struct wl_proxy *)params[i], queue);
+        zwp_linux_buffer_params_v1_add_listener(params[i], &dmabuf_params_listener, &results[i]);
+        zwp_linux_buffer_params_v1_add(params[i], dmabuf_fd, 0, 0, app->stride,
+                                       DRM_FORMAT_MOD_LINEAR >> 32, DRM_FORMAT_MOD_LINEAR & 0xFFFFFFFF);
+        zwp_linux_buffer_params_v1_create(params[i], app->width, app->height, format, 0);
+        close(dmabuf_fd);
+        sent = true;
+    }
+
+    /* The answers come before the roundtrip's own callback */
+    if (sent) {
+        wl_display_roundtrip_queue(app->display, queue);
+    }
+
+    for (i = 0; i < WAYLAND_BUF_CNT; i++) {
+        if (params[i] == NULL) {
+            continue;
+        }
+
+        zwp_linux_buffer_params_v1_destroy(params[i]);
+
+        if (results[i].wl_buffer) {
+            /* Its release events are handled with the others */
+            wl_proxy_set_queue((struct wl_proxy *)results[i].wl_buffer, NULL);
+            app->buffers[i].wl_buffer = results[i].wl_buffer;
+        } else {
+            app->dmabuf_rejected = true;
+        }
+    }
+
+    wl_event_queue_destroy(queue);
+
+    if (app->dmabuf_rejected) {
+        LV_LOG_WARN("dma-buf not accepted, using wl_shm buffers from now on\n");
+    }
+}
+
+static void dmabuf_handle_format(void *data, struct zwp_linux_dmabuf_v1 *dmabuf, uint32_t format)
+{
+    /* Deprecated, the modifier event tells the supported layouts */
+}
+
+static void dmabuf_handle_modifier(void *data, struct zwp_linux_dmabuf_v1 *dmabuf, uint32_t format,
+                                   uint32_t modifier_hi, uint32_t modifier_lo)
+{
+    struct application *app = data;
+    const uint64_t modifier = ((uint64_t)modifier_hi << 32) | modifier_lo;
+
+    /* Only the linear layout can be written by the CPU */
+    if (modifier != DRM_FORMAT_MOD_LINEAR) {
+        return;
+    }
+
+    switch (format) {
+    case DRM_FORMAT_ARGB8888:
+    case DRM_FORMAT_XRGB8888:
+    case DRM_FORMAT_RGB565:
+    case DRM_FORMAT_RGB332:
+        if (app->dmabuf_format_cnt < (int)(sizeof(app->dmabuf_formats) / sizeof(app->dmabuf_formats[0]))) {
+            app->dmabuf_formats[app->dmabuf_format_cnt++] = format;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static void dmabuf_params_handle_created(void *data, struct zwp_linux_buffer_params_v1 *params,
+                                         struct wl_buffer *wl_buffer)
+{
+    struct dmabuf_result *result = data;
+
+    result->wl_buffer = wl_buffer;
+}
+
+static void dmabuf_params_handle_failed(void *data, struct zwp_linux_buffer_params_v1 *params)
+{
+    /* The result keeps its NULL buffer, wl_shm is used instead */
+}
+#endif
+
+static void buffers_destroy(struct application *app)
+{
+    int i;
+
+    for (i = 0; i < WAYLAND_BUF_CNT; i++) {
+        if (app->buffers[i].wl_buffer) {
+            wl_buffer_destroy(app->buffers[i].wl_buffer);
+            app->buffers[i].wl_buffer = NULL;
+        }
+    }
+
+    if (app->data) {
+        munmap(app->data, app->data_size);
+        app->data = NULL;
+    }
+
+    app->draw_buffer = NULL;
+    app->last_buffer = NULL;
+    app->frame_dirty = false;
+}
+
+static struct buffer * buffer_acquire(struct application *app)
+{
+    struct buffer *buffer = NULL;
+    int i;
+
+    /* Wait until the compositor releases a buffer */
+    app_lock(app);
+    while (buffer == NULL) {
+        for (i = 0; i < WAYLAND_BUF_CNT; i++) {
+            if (!app->buffers[i].busy) {
+                buffer = &app->buffers[i];
+                break;
+            }
+        }
+        if (buffer == NULL) {
+#if WAYLAND_DISPATCH_THREAD
+            pthread_cond_wait(&app->buffer_released, &app->mutex);
+#else
+            /* Block until the compositor sends something, hopefully a release */
+            if (wl_display_dispatch(app->display) < 0) {
+                LV_LOG_ERROR("lost the connection while waiting for a buffer\n");
+                return NULL;
+            }
+#endif
+        }
+    }
+    app_unlock(app);
+
+    /* Bring the buffer up to date with the areas drawn since it was presented */
+    if (buffer->stale) {
+        if (app->last_buffer && (app->last_buffer != buffer)) {
+            buffer_copy_area(app, buffer, app->last_buffer, &buffer->stale_area);
+        }
+        buffer->stale = false;
+    }
+
+    return buffer;
+}
+
+static void buffer_copy_area(struct application *app, struct buffer *dst,
+                             const struct buffer *src, const lv_area_t *area)
+{
+    const size_t stride = app->stride;
+    const size_t offset = (area->y1 * stride) + (area->x1 * BYTES_PER_PIXEL);
+    const size_t len = lv_area_get_width(area) * BYTES_PER_PIXEL;
+    uint8_t *dst_row = (uint8_t *)dst->data + offset;
+    const uint8_t *src_row = (const uint8_t *)src->data + offset;
+    int32_t y;
+
+    for (y = area->y1; y <= area->y2; y++) {
+        memcpy(dst_row, src_row, len);
+        dst_row += stride;
+        src_row += stride;
+    }
+}
+
+static inline void buffer_copy_row(uint8_t *dst, const lv_color_t *src, int32_t len)
+{
+#if (LV_COLOR_DEPTH == 1)
+    /* Convert to RGB332 */
+    int32_t i;
+    for (i = 0; i < len; i++) {
+        dst[i] = ((0x07 * src[i].ch.red)   << 5) |
+                 ((0x07 * src[i].ch.green) << 2) |
+                 ((0x03 * src[i].ch.blue)  << 0);
+    }
+#elif (LV_COLOR_DEPTH == 16) && LV_COLOR_16_SWAP
+    /* WL_SHM_FORMAT_RGB565 is little endian */
+    uint16_t *dst16 = (uint16_t *)dst;
+    int32_t i;
+    for (i = 0; i < len; i++) {
+        dst16[i] = (uint16_t)((src[i].full >> 8) | (src[i].full << 8));
+    }
+#else
+    /* The shm format has the same layout as lv_color_t */
+    memcpy(dst, src, len * sizeof(lv_color_t));
+#endif
+}
+
+static void buffer_handle_release(void *data, struct wl_buffer *wl_buffer)
+{
+    struct application *app = data;
+    int i;
+
+    app_lock(app);
+    for (i = 0; i < WAYLAND_BUF_CNT; i++) {
+        if (app->buffers[i].wl_buffer == wl_buffer) {
+            app->buffers[i].busy = false;
+        }
+    }
+#if WAYLAND_DISPATCH_THREAD
+    pthread_cond_signal(&app->buffer_released);
+#endif
+    app_unlock(app);
+}
+
+static void frame_commit(struct application *app)
+{
+    struct buffer *buffer = app->draw_buffer;
+    int i;
+
+    /* The buffers were re-created (or couldn't be) since the frame was drawn */
+    if (buffer == NULL) {
+        app->frame_dirty = false;
+        return;
+    }
+
+    /* The compositor owns the buffer until it sends wl_buffer.release */
+    app_lock(app);
+    buffer->busy = true;
+    app->frame_callback = wl_surface_frame(app->surface);
+    wl_callback_add_listener(app->frame_callback, &frame_listener, app);
+    app_unlock(app);
+
+    wl_surface_attach(app->surface, buffer->wl_buffer, 0, 0);
+    wl_surface_commit(app->surface);
+
+    /* Don't render until the compositor asks for the next frame.
+     * No callback comes while the surface is hidden, so nothing is rendered in vain. */
+    app->frame_pending = true;
+    if (app->disp) {
+        lv_timer_pause(app->disp->refr_timer);
+    }
+
+    /* Pass the frame callback to LVGL as soon as it arrives */
+    app->frame_commit_tick = lv_tick_get();
+    if (app->frame_timer) {
+        lv_timer_set_period(app->frame_timer, FRAME_WAIT_PERIOD);
+    }
+
+    wl_display_flush(app->display);
+
+    /* The other buffers miss the areas of this frame */
+    for (i = 0; i < WAYLAND_BUF_CNT; i++) {
+        struct buffer *other = &app->buffers[i];
+        if (other == buffer) {
+            continue;
+        }
+        if (other->stale) {
+            _lv_area_join(&other->stale_area, &other->stale_area, &app->frame_area);
+        } else {
+            other->stale_area = app->frame_area;
+            other->stale = true;
+        }
+    }
+
+    app->last_buffer = buffer;
+    app->draw_buffer = NULL;
+    app->frame_dirty = false;
+}
+
+static void frame_handle_done(void *data, struct wl_callback *callback, uint32_t time)
+{
+    struct application *app = data;
+
+    app_lock(app);
+    if (app->frame_callback == callback) {
+        app->frame_callback = NULL;
+    }
+    app->frame_done = true;
+    app_unlock(app);
+
+    wl_callback_destroy(callback);
+}
+
+static void frame_timer_cb(lv_timer_t *timer)
+{
+#if WAYLAND_DISPATCH_THREAD
+    frame_process(timer->user_data);
+#else
+    /* Reads the events and processes them */
+    (void)timer;
+    wayland_dispatch();
+#endif
+}
+
+/* Pass the configure events and the frame callbacks received since the last call to LVGL */
+static void frame_process(struct application *app)
+{
+    bool done;
+
+    /* Resize the buffers and the display if the shell asked for it */
+    surface_apply_configure(app);
+    if (app->disp && app->data &&
+        ((app->disp->driver->hor_res != app->width) || (app->disp->driver->ver_res != app->height))) {
+        app->disp->driver->hor_res = app->width;
+        app->disp->driver->ver_res = app->height;
+        lv_disp_drv_update(app->disp, app->disp->driver);
+    }
+
+    app_lock(app);
+    done = app->frame_done;
+    app->frame_done = false;
+    app_unlock(app);
+
+    if (!done) {
+        /* No callback for a while, the window is hidden: check only once per refresh period */
+        if (app->frame_pending && app->frame_timer &&
+            (lv_tick_elaps(app->frame_commit_tick) > 2 * frame_refr_period(app))) {
+            lv_timer_set_period(app->frame_timer, frame_refr_period(app));
+        }
+        return;
+    }
+
+    app->frame_pending = false;
+    if (app->frame_timer) {
+        lv_timer_set_period(app->frame_timer, frame_refr_period(app));
+    }
+
+    if (app->frame_dirty) {
+        /* A refresh was drawn while waiting, present it now */
+        frame_commit(app);
+    } else if (app->disp) {
+        lv_timer_resume(app->disp->refr_timer);
+        lv_timer_ready(app->disp->refr_timer);
+    }
+}
+
+/* Pace of `frame_timer` while no frame callback is expected */
+static uint32_t frame_refr_period(struct application *app)
+{
+    return app->disp ? app->disp->refr_timer->period : LV_DISP_DEF_REFR_PERIOD;
+}
+
+static void shell_handle_ping(void *data, struct wl_shell_surface *shell_surface, uint32_t serial)
+{
+    wl_shell_surface_pong(shell_surface, serial);
+}
+
+static void shell_handle_configure(void *data, struct wl_shell_surface *shell_surface,
+                                   uint32_t edges, int32_t width, int32_t height)
+{
+    struct application *app = data;
+
+    if ((width <= 0) || (height <= 0)) {
+        return;
+    }
+
+    app_lock(app);
+    app->configure.width = width;
+    app->configure.height = height;
+    app->configure.pending = true;
+    app_unlock(app);
+}
+
+static void shell_handle_popup_done(void *data, struct wl_shell_surface *shell_surface)
+{
+}
+
+#if WAYLAND_XDG_SHELL
+static void xdg_wm_base_handle_ping(void *data, struct xdg_wm_base *xdg_wm_base, uint32_t serial)
+{
+    xdg_wm_base_pong(xdg_wm_base, serial);
+}
+
+static void xdg_surface_handle_configure(void *data, struct xdg_surface *xdg_surface, uint32_t serial)
+{
+    struct application *app = data;
+
+    app_lock(app);
+    app->configure.serial = serial;
+    app->configure.pending = true;
+    app_unlock(app);
+}
+
+static void xdg_toplevel_handle_configure(void *data, struct xdg_toplevel *xdg_toplevel,
+                                          int32_t width, int32_t height, struct wl_array *states)
+{
+    struct application *app = data;
+    uint32_t *state;
+    bool fullscreen = false;
+    bool maximized = false;
+
+    wl_array_for_each(state, states) {
+        if (*state == XDG_TOPLEVEL_STATE_FULLSCREEN) {
+            fullscreen = true;
+        } else if (*state == XDG_TOPLEVEL_STATE_MAXIMIZED) {
+            maximized = true;
+        }
+    }
+
+    app_lock(app);
+
+    /* 0x0 leaves the size to the client (e.g. on activation): the output's size in fullscreen,
+     * the last normal size when leaving fullscreen or maximized, else the current size,
+     * which is the default one until the first resize */
+    if ((width <= 0) || (height <= 0)) {
+        if (fullscreen && (app->output_width > 0) && (app->output_height > 0)) {
+            width = app->output_width;
+            height = app->output_height;
+        } else if (!fullscreen && !maximized) {
+            width = app->configure.windowed_width;
+            height = app->configure.windowed_height;
+        } else {
+            width = 0;
+            height = 0;
+        }
+    }
+
+    /* Applied on the following xdg_surface.configure */
+    app->configure.width = width;
+    app->configure.height = height;
+    app->configure.windowed = !fullscreen && !maximized;
+
+    app_unlock(app);
+}
+
+static void xdg_toplevel_handle_close(void *data, struct xdg_toplevel *xdg_toplevel)
+{
+    struct application *app = data;
+
+    app->close_requested = true;
+}
+#endif
+
+static void surface_apply_configure(struct application *app)
+{
+    bool pending;
+    bool windowed;
+    int width;
+    int height;
+    uint32_t serial;
+
+    app_lock(app);
+    pending = app->configure.pending;
+    windowed = app->configure.windowed;
+    width = app->configure.width;
+    height = app->configure.height;
+    serial = app->configure.serial;
+    app->configure.pending = false;
+    app_unlock(app);
+
+    if (!pending) {
+        return;
+    }
+
+    if ((width <= 0) || (height <= 0)) {
+        width = app->width;
+        height = app->height;
+    }
+
+    /* Restored when leaving fullscreen or maximized state */
+    if (windowed) {
+        app_lock(app);
+        app->configure.windowed_width = width;
+        app->configure.windowed_height = height;
+        app_unlock(app);
+    }
+
+    /* The old buffers can be destroyed even if the compositor still uses them,
+     * the pool stays alive until the compositor releases them */
+    if ((width != app->width) || (height != app->height) || (app->data == NULL)) {
+        buffers_destroy(app);
+        app->width = width;
+        app->height = height;
+        if (!buffers_create(app)) {
+            LV_LOG_ERROR("cannot resize buffers to %dx%d\n", width, height);
+        }
+    }
+
+#if WAYLAND_XDG_SHELL
+    if (app->xdg_surface) {
+        xdg_surface_ack_configure(app->xdg_surface, serial);
+    }
+#else
+    (void)serial;
+#endif
+}
+
+static void output_handle_geometry(void *data, struct wl_output *output, int32_t x, int32_t y,
+                                   int32_t physical_width, int32_t physical_height,
+                                   int32_t subpixel, const char *make, const char *model,
+                                   int32_t transform)
+{
+}
+
+static void output_handle_mode(void *data, struct wl_output *output, uint32_t flags,
+                               int32_t width, int32_t height, int32_t refresh)
+{
+    struct application *app = data;
+
+    if (flags & WL_OUTPUT_MODE_CURRENT) {
+        app_lock(app);
+        app->output_width = width;
+        app->output_height = height;
+        app_unlock(app);
+    }
+}
+
+static void output_handle_done(void *data, struct wl_output *output)
+{
+}
+
+static void output_handle_scale(void *data, struct wl_output *output, int32_t factor)
+{
+}
 
 static void seat_handle_capabilities(void *data, struct wl_seat *wl_seat, enum wl_seat_capability caps)
 {
@@ -613,12 +1775,12 @@ static void pointer_handle_motion(void *data, struct wl_pointer *pointer,
 {
     struct application *app = data;
 
-    pthread_mutex_lock(&app->mutex);
+    app_lock(app);
 
     app->input.mouse.x = wl_fixed_to_int(sx);
     app->input.mouse.y = wl_fixed_to_int(sy);
 
-    pthread_mutex_unlock(&app->mutex);
+    app_unlock(app);
 }
 
 static void pointer_handle_button(void *data, struct wl_pointer *wl_pointer,
@@ -629,23 +1791,26 @@ static void pointer_handle_button(void *data, struct wl_pointer *wl_pointer,
     const lv_indev_state_t lv_state =
         (state == WL_POINTER_BUTTON_STATE_PRESSED) ? LV_INDEV_STATE_PR : LV_INDEV_STATE_REL;
 
-    pthread_mutex_lock(&app->mutex);
+    app_lock(app);
 
     switch (button & 0xF) {
     case 0:
         app->input.mouse.left_button = lv_state;
+        input_queue_push(&app->input.mouse.queue,
+                         app->input.mouse.x, app->input.mouse.y, 0, lv_state);
         break;
     case 1:
         app->input.mouse.right_button = lv_state;
         break;
     case 2:
         app->input.mouse.wheel_button = lv_state;
+        input_queue_push(&app->input.mouse.wheel_queue, 0, 0, 0, lv_state);
         break;
     default:
         break;
     }
 
-    pthread_mutex_unlock(&app->mutex);
+    app_unlock(app);
 }
 
 static void pointer_handle_axis(void *data, struct wl_pointer *wl_pointer,
@@ -655,14 +1820,14 @@ static void pointer_handle_axis(void *data, struct wl_pointer *wl_pointer,
     const int diff = wl_fixed_to_int(value);
 
     if (axis == 0) {
-        pthread_mutex_lock(&app->mutex);
+        app_lock(app);
         if (diff > 0) {
             app->input.mouse.wheel_diff++;
         }
         else if (diff < 0) {
             app->input.mouse.wheel_diff--;
         }
-        pthread_mutex_unlock(&app->mutex);
+        app_unlock(app);
     }
 }
 
@@ -744,10 +1909,11 @@ static void keyboard_handle_key(void *data, struct wl_keyboard *keyboard,
         (state == WL_KEYBOARD_KEY_STATE_PRESSED) ? LV_INDEV_STATE_PR : LV_INDEV_STATE_REL;
 
     if (lv_key != 0) {
-        pthread_mutex_lock(&app->mutex);
+        app_lock(app);
         app->input.keyboard.key = lv_key;
         app->input.keyboard.state = lv_state;
-        pthread_mutex_unlock(&app->mutex);
+        input_queue_push(&app->input.keyboard.queue, 0, 0, lv_key, lv_state);
+        app_unlock(app);
     }
 }
 
@@ -772,13 +1938,15 @@ static void touch_handle_down(void *data, struct wl_touch *wl_touch,
 {
     struct application *app = data;
 
-    pthread_mutex_lock(&app->mutex);
+    app_lock(app);
 
     app->input.touch.x = wl_fixed_to_int(x_w);
     app->input.touch.y = wl_fixed_to_int(y_w);
     app->input.touch.state = LV_INDEV_STATE_PR;
+    input_queue_push(&app->input.touch.queue,
+                     app->input.touch.x, app->input.touch.y, 0, LV_INDEV_STATE_PR);
 
-    pthread_mutex_unlock(&app->mutex);
+    app_unlock(app);
 }
 
 static void touch_handle_up(void *data, struct wl_touch *wl_touch,
@@ -786,11 +1954,13 @@ static void touch_handle_up(void *data, struct wl_touch *wl_touch,
 {
     struct application *app = data;
 
-    pthread_mutex_lock(&app->mutex);
+    app_lock(app);
 
     app->input.touch.state = LV_INDEV_STATE_REL;
+    input_queue_push(&app->input.touch.queue,
+                     app->input.touch.x, app->input.touch.y, 0, LV_INDEV_STATE_REL);
 
-    pthread_mutex_unlock(&app->mutex);
+    app_unlock(app);
 }
 
 static void touch_handle_motion(void *data, struct wl_touch *wl_touch,
@@ -798,12 +1968,12 @@ static void touch_handle_motion(void *data, struct wl_touch *wl_touch,
 {
     struct application *app = data;
 
-    pthread_mutex_lock(&app->mutex);
+    app_lock(app);
 
     app->input.touch.x = wl_fixed_to_int(x_w);
     app->input.touch.y = wl_fixed_to_int(y_w);
 
-    pthread_mutex_unlock(&app->mutex);
+    app_unlock(app);
 }
 
 static void touch_handle_frame(void *data, struct wl_touch *wl_touch)
@@ -814,6 +1984,38 @@ static void touch_handle_cancel(void *data, struct wl_touch *wl_touch)
 {
 }
 
+static void input_queue_push(struct input_queue *queue, lv_coord_t x, lv_coord_t y,
+                             lv_key_t key, lv_indev_state_t state)
+{
+    struct input_item *event;
+
+    /* If LVGL doesn't keep up drop the oldest event, the newest state is what matters */
+    if (queue->cnt == WAYLAND_INPUT_QUEUE_SIZE) {
+        queue->head = (queue->head + 1) % WAYLAND_INPUT_QUEUE_SIZE;
+        queue->cnt--;
+    }
+
+    event = &queue->events[(queue->head + queue->cnt) % WAYLAND_INPUT_QUEUE_SIZE];
+    event->x = x;
+    event->y = y;
+    event->key = key;
+    event->state = state;
+    queue->cnt++;
+}
+
+static bool input_queue_pop(struct input_queue *queue, struct input_item *event)
+{
+    if (queue->cnt == 0) {
+        return false;
+    }
+
+    *event = queue->events[queue->head];
+    queue->head = (queue->head + 1) % WAYLAND_INPUT_QUEUE_SIZE;
+    queue->cnt--;
+
+    return true;
+}
+
 static lv_key_t keycode_xkb_to_lv(xkb_keysym_t xkb_key)
 {
     lv_key_t key = 0;
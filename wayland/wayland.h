@@ -44,6 +44,11 @@ extern "C" {
 void wayland_init(void);
 void wayland_deinit(void);
 void wayland_flush(lv_disp_drv_t * disp_drv, const lv_area_t * area, lv_color_t * color_p);
+int wayland_get_fd(void);
+bool wayland_dispatch(void);
+void wayland_set_fullscreen(bool fullscreen);
+void wayland_set_maximized(bool maximized);
+bool wayland_is_close_requested(void);
 void wayland_pointer_read(lv_indev_drv_t * drv, lv_indev_data_t * data);
 void wayland_pointeraxis_read(lv_indev_drv_t * drv, lv_indev_data_t * data);
 void wayland_keyboard_read(lv_indev_drv_t * drv, lv_indev_data_t * data);